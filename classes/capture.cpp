@@ -0,0 +1,325 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     capture.cpp
+//
+//*****************************************************************************
+//
+//  Standard string class.
+//
+#include <string>
+//
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Primitive numeric conversions.
+//
+#include <charconv>
+//
+//  C string handling functions.
+//
+#include <cstring>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//  C error numbers.
+//
+#include <cerrno>
+//
+//  POSIX file control, write, memory mapping and scatter/gather I/O.
+//
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+//
+//
+//
+#include "cpu.h"
+#include "system.h"
+#include "parser.h"
+#include "chunk_parser.h"
+#include "sampler.h"
+#include "capture.h"
+
+namespace procstat
+{
+  //*****************************************************************************
+  //
+  //  Constructor.
+  //
+  //*****************************************************************************
+  CaptureWriter::CaptureWriter(int fd)
+    : fd(fd), failed(false)
+  {
+
+  }
+
+  //*****************************************************************************
+  //
+  //  This method appends a record with a single writev call, so records
+  //  written by several processes to the same file (open with O_APPEND)
+  //  are not interleaved. Partial writes are completed with more calls.
+  //
+  //*****************************************************************************
+  bool CaptureWriter::write(const Sample &sample)
+  {
+    char header[24];
+    char* pos = header;
+
+    *pos++ = '@';
+    pos = std::to_chars(pos, header + sizeof(header) - 1, sample.wall_time / 1000000).ptr;
+    *pos++ = '\n';
+
+    struct iovec parts[2];
+    parts[0].iov_base = header;
+    parts[0].iov_len = pos - header;
+    parts[1].iov_base = const_cast<char*>(sample.data);
+    parts[1].iov_len = sample.length;
+
+    uint8_t part = 0;
+
+    while (part < 2 && !this->failed)
+    {
+      ssize_t written = writev(this->fd, &parts[part], 2 - part);
+
+      if (written < 0 && errno != EINTR)
+      {
+        this->failed = true;
+      }
+
+      //
+      //  Skip the parts fully written and move
+      //  the start of the first one left.
+      //
+      while (written > 0 && part < 2)
+      {
+        size_t done = (static_cast<size_t>(written) < parts[part].iov_len) ?
+                      written : parts[part].iov_len;
+
+        parts[part].iov_base = static_cast<char*>(parts[part].iov_base) + done;
+        parts[part].iov_len -= done;
+        written -= done;
+
+        if (parts[part].iov_len == 0)
+        {
+          part++;
+        }
+      }
+    }
+
+    return !this->failed;
+  }
+
+  //*****************************************************************************
+  //
+  //  This static method writes a sample with the writer given as context.
+  //  Write errors are kept in the writer and checked with has_failed.
+  //
+  //*****************************************************************************
+  void CaptureWriter::on_sample(const Sample &sample, void* context)
+  {
+    static_cast<CaptureWriter*>(context)->write(sample);
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns true if a previous write failed.
+  //
+  //*****************************************************************************
+  bool CaptureWriter::has_failed(void) const
+  {
+    return this->failed;
+  }
+
+  //*****************************************************************************
+  //
+  //  Constructor: Initialize an empty mapping.
+  //
+  //*****************************************************************************
+  CaptureReader::CaptureReader()
+    : map(nullptr), size(0), pos(0)
+  {
+
+  }
+
+  //*****************************************************************************
+  //
+  //  Destructor: Unmap the file.
+  //
+  //*****************************************************************************
+  CaptureReader::~CaptureReader()
+  {
+    if (this->map)
+    {
+      munmap(const_cast<char*>(this->map), this->size);
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This method maps the whole file read-only. The file is read once from
+  //  start to end, which is told to the kernel so it reads ahead. The file
+  //  descriptor is not needed once the file is mapped.
+  //
+  //*****************************************************************************
+  bool CaptureReader::open(const char* path)
+  {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    struct stat info;
+
+    if (fd < 0)
+    {
+      return false;
+    }
+
+    if (fstat(fd, &info) < 0)
+    {
+      close(fd);
+      return false;
+    }
+
+    this->size = info.st_size;
+    this->pos = 0;
+
+    if (this->size > 0)
+    {
+      void* map = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if (map == MAP_FAILED)
+      {
+        close(fd);
+        return false;
+      }
+
+      madvise(map, this->size, MADV_SEQUENTIAL);
+      this->map = static_cast<const char*>(map);
+    }
+
+    close(fd);
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the time of the first record, which starts the
+  //  file.
+  //
+  //*****************************************************************************
+  uint64_t CaptureReader::get_first_time(void) const
+  {
+    if (this->size == 0 || this->map[0] != '@')
+    {
+      return 0;
+    }
+
+    return parse_time(this->map + 1, this->map + this->size);
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the time of the last complete record, searching
+  //  the record headers backwards from the end of the file.
+  //
+  //*****************************************************************************
+  uint64_t CaptureReader::get_last_time(void) const
+  {
+    const char* end = this->map + this->size;
+    bool complete = (this->size > 0 && end[-1] == '\n');
+
+    for (size_t i = this->size; i > 0; i--)
+    {
+      const char* pos = this->map + i - 1;
+
+      if (*pos == '@' && (i == 1 || pos[-1] == '\n'))
+      {
+        if (complete)
+        {
+          return parse_time(pos + 1, end);
+        }
+
+        //
+        //  The last record is cut short, so
+        //  the previous one is the last.
+        //
+        complete = true;
+      }
+    }
+
+    return 0;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the record at the current position and moves to
+  //  the next one, which starts after the first new line followed by "@".
+  //
+  //*****************************************************************************
+  bool CaptureReader::next(uint64_t &time_ms, const char* &data, size_t &length)
+  {
+    const char* end = this->map + this->size;
+    const char* pos = this->map + this->pos;
+
+    if (pos >= end || *pos != '@')
+    {
+      return false;
+    }
+
+    const char* header_end = static_cast<const char*>(memchr(pos, '\n', end - pos));
+
+    if (!header_end)
+    {
+      return false;
+    }
+
+    const char* record_end = static_cast<const char*>(memmem(header_end, end - header_end, "\n@", 2));
+    record_end = record_end ? (record_end + 1) : end;
+
+    //
+    //  A complete snapshot always ends with a new line.
+    //
+    if (record_end == end && end[-1] != '\n')
+    {
+      this->pos = this->size;
+      return false;
+    }
+
+    time_ms = parse_time(pos + 1, header_end);
+    data = header_end + 1;
+    length = record_end - data;
+
+    this->pos = record_end - this->map;
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method goes back to the first record.
+  //
+  //*****************************************************************************
+  void CaptureReader::rewind(void)
+  {
+    this->pos = 0;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method parses the digits of a record header.
+  //
+  //*****************************************************************************
+  uint64_t CaptureReader::parse_time(const char* begin, const char* end)
+  {
+    uint64_t time_ms = 0;
+
+    std::from_chars(begin, end, time_ms);
+
+    return time_ms;
+  }
+}
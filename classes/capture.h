@@ -0,0 +1,103 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     capture.h
+//
+//*****************************************************************************
+
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+namespace procstat
+{
+  //*****************************************************************************
+  //
+  //  CaptureWriter class.
+  //  This class appends the raw "/proc/stat" snapshots to a capture file.
+  //  Each record is a line holding "@" and the wall time in milliseconds,
+  //  followed by the snapshot as read. No line of the file starts with "@",
+  //  so the records can be split without any length field.
+  //
+  //*****************************************************************************
+  class CaptureWriter
+  {
+    public:
+      //
+      //  Constructor.
+      //
+      CaptureWriter(int fd);
+
+      //
+      //  Append a sample to the file. The static version can be given to
+      //  Sampler::subscribe with the writer as context. Returns false on
+      //  a write error.
+      //
+      bool write(const Sample &sample);
+      static void on_sample(const Sample &sample, void* context);
+
+      //
+      //  Getter method for the write error state.
+      //
+      bool has_failed(void) const;
+    private:
+      int fd;
+      bool failed;
+  };
+
+  //*****************************************************************************
+  //
+  //  CaptureReader class.
+  //  This class maps a capture file in memory and walks through its records
+  //  without copying them. A last record cut short (e.g. the host stopped
+  //  while writing it) is ignored.
+  //
+  //*****************************************************************************
+  class CaptureReader
+  {
+    public:
+      //
+      //  Constructor and destructor. The destructor unmaps the file.
+      //
+      CaptureReader();
+      ~CaptureReader();
+
+      //
+      //  The CaptureReader owns the file mapping, so it cannot be copied.
+      //
+      CaptureReader(const CaptureReader &) = delete;
+      CaptureReader &operator=(const CaptureReader &) = delete;
+
+      //
+      //  Map a capture file. Returns false if it cannot be open or mapped.
+      //
+      bool open(const char* path);
+
+      //
+      //  Getter methods for the wall time in milliseconds of the first and
+      //  last records, without walking through the file. Both are 0 if the
+      //  file holds no record.
+      //
+      uint64_t get_first_time(void) const;
+      uint64_t get_last_time(void) const;
+
+      //
+      //  Get the next record, its wall time in milliseconds and the
+      //  snapshot. Returns false when there are no more records.
+      //
+      bool next(uint64_t &time_ms, const char* &data, size_t &length);
+
+      //
+      //  Go back to the first record.
+      //
+      void rewind(void);
+    private:
+      const char* map;
+      size_t size;
+      size_t pos;
+
+      static uint64_t parse_time(const char* begin, const char* end);
+  };
+}
+
+#endif  // __CAPTURE_H__
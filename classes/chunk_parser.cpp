@@ -0,0 +1,437 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     chunk_parser.cpp
+//
+//*****************************************************************************
+//
+//  Standard string class.
+//
+#include <string>
+//
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Standard thread class, mutex and condition variables.
+//
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+//
+//  POSIX threads, signals and CPU affinity.
+//
+#include <pthread.h>
+#include <signal.h>
+#include <sched.h>
+//
+//  C string handling functions.
+//
+#include <cstring>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//
+//
+#include "cpu.h"
+#include "system.h"
+#include "parser.h"
+#include "chunk_parser.h"
+
+namespace procstat
+{
+  //
+  //  Stack size of the worker threads. A chunk is parsed with a few
+  //  hundred bytes of stack, and a small stack keeps the memory locked
+  //  by the daemon low.
+  //
+  static const size_t WORKER_STACK_SIZE = 256 * 1024;
+
+  //*****************************************************************************
+  //
+  //  Pool structure.
+  //  Worker threads and the chunks of the snapshot being parsed. Worker i
+  //  parses tasks[i] when the generation changes and i is below the number
+  //  of active workers, and the last one to finish signals done.
+  //
+  //*****************************************************************************
+  struct ChunkParser::Pool
+  {
+    struct Task
+    {
+      Pool* pool;
+      uint32_t index;
+      uint64_t generation;
+      const char* begin;
+      const char* end;
+      uint32_t line_cnt;
+    };
+
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    std::vector<pthread_t> threads;
+    std::vector<Task> tasks;
+    Cpu* cpu = nullptr;
+    uint32_t cpu_cnt = 0;
+    System* system = nullptr;
+    uint64_t generation = 0;
+    uint32_t active = 0;
+    uint32_t pending = 0;
+    bool stopping = false;
+  };
+
+  //*****************************************************************************
+  //
+  //  This function returns the number of CPUs the calling thread may run on
+  //  (e.g. 1 once pinned to a CPU), or the number of hardware threads if it
+  //  cannot be read.
+  //
+  //*****************************************************************************
+  static uint32_t get_affinity_count(void)
+  {
+    for (uint32_t cpu_cnt = 1024; cpu_cnt <= 1048576; cpu_cnt *= 4)
+    {
+      cpu_set_t* set = CPU_ALLOC(cpu_cnt);
+      size_t size = CPU_ALLOC_SIZE(cpu_cnt);
+
+      if (!set)
+      {
+        break;
+      }
+
+      int result = sched_getaffinity(0, size, set);
+      uint32_t count = (result == 0) ? static_cast<uint32_t>(CPU_COUNT_S(size, set)) : 0;
+      CPU_FREE(set);
+
+      if (result == 0)
+      {
+        return count;
+      }
+    }
+
+    return std::thread::hardware_concurrency();
+  }
+
+  //*****************************************************************************
+  //
+  //  Constructor: Set the number of threads. The worker threads are only
+  //  started by the first snapshot that is split.
+  //
+  //*****************************************************************************
+  ChunkParser::ChunkParser(uint32_t thread_cnt, size_t chunk_size)
+    : thread_cnt(1), chunk_size(chunk_size), pool(nullptr)
+  {
+    set_thread_count(thread_cnt);
+
+    if (this->chunk_size == 0)
+    {
+      this->chunk_size = 1;
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  Destructor: Stop the worker threads.
+  //
+  //*****************************************************************************
+  ChunkParser::~ChunkParser()
+  {
+    stop_pool();
+  }
+
+  //*****************************************************************************
+  //
+  //  This method changes the maximum number of threads, using the number of
+  //  CPUs the calling thread may run on when none is given. The worker
+  //  threads are stopped, and started again with the new number if needed.
+  //
+  //*****************************************************************************
+  void ChunkParser::set_thread_count(uint32_t thread_cnt)
+  {
+    stop_pool();
+
+    this->thread_cnt = (thread_cnt == 0) ? get_affinity_count() : thread_cnt;
+
+    if (this->thread_cnt == 0)
+    {
+      this->thread_cnt = 1;
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the maximum number of threads.
+  //
+  //*****************************************************************************
+  uint32_t ChunkParser::get_thread_count(void) const
+  {
+    return this->thread_cnt;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the number of chunks a snapshot is split into: one
+  //  per chunk_size bytes, at most one per thread, and at least one.
+  //
+  //*****************************************************************************
+  uint32_t ChunkParser::get_chunk_count(size_t length) const
+  {
+    size_t chunk_cnt = length / this->chunk_size;
+
+    chunk_cnt = (chunk_cnt > this->thread_cnt) ? this->thread_cnt : chunk_cnt;
+
+    return (chunk_cnt == 0) ? 1 : static_cast<uint32_t>(chunk_cnt);
+  }
+
+  //*****************************************************************************
+  //
+  //  This method splits the snapshot into chunks of about the same size,
+  //  moving each boundary forward to the next new line character. The
+  //  calling thread parses the last chunk and the others are handed to the
+  //  worker threads, which are waited for before returning. If the worker
+  //  threads cannot be started, the whole snapshot is parsed on the calling
+  //  thread, and so are the next ones until set_thread_count is called, so
+  //  the start is not retried on every snapshot.
+  //
+  //*****************************************************************************
+  uint32_t ChunkParser::parse(const char* data, size_t length, Cpu* cpu, uint32_t cpu_cnt,
+                              System &system)
+  {
+    uint32_t chunk_cnt = get_chunk_count(length);
+    const char* end = data + length;
+
+    if (chunk_cnt > 1 && !this->pool && !start_pool())
+    {
+      this->thread_cnt = 1;
+      chunk_cnt = 1;
+    }
+
+    if (chunk_cnt == 1)
+    {
+      return parse_chunk(data, end, cpu, cpu_cnt, &system);
+    }
+
+    Pool &pool = *this->pool;
+    const char* begin = data;
+    std::unique_lock<std::mutex> lock(pool.mutex);
+
+    for (uint32_t i = 0; i < (chunk_cnt - 1); i++)
+    {
+      const char* chunk_end = data + (length / chunk_cnt) * (i + 1);
+      chunk_end = (chunk_end < begin) ? begin : chunk_end;
+
+      const char* new_line = static_cast<const char*>(memchr(chunk_end, '\n', end - chunk_end));
+      chunk_end = new_line ? (new_line + 1) : end;
+
+      pool.tasks[i].begin = begin;
+      pool.tasks[i].end = chunk_end;
+      pool.tasks[i].line_cnt = 0;
+      begin = chunk_end;
+    }
+
+    pool.cpu = cpu;
+    pool.cpu_cnt = cpu_cnt;
+    pool.system = &system;
+    pool.active = chunk_cnt - 1;
+    pool.pending = chunk_cnt - 1;
+    pool.generation++;
+
+    lock.unlock();
+    pool.start.notify_all();
+
+    uint32_t line_cnt = parse_chunk(begin, end, cpu, cpu_cnt, &system);
+
+    lock.lock();
+    pool.done.wait(lock, [&pool]() { return pool.pending == 0; });
+
+    for (uint32_t i = 0; i < (chunk_cnt - 1); i++)
+    {
+      line_cnt += pool.tasks[i].line_cnt;
+    }
+
+    return line_cnt;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method starts one worker thread per thread but the calling
+  //  one. The workers block every signal, so the signals keep going to the
+  //  thread waiting for them (e.g. through a signal file descriptor).
+  //  Returns false if the threads cannot be started.
+  //
+  //*****************************************************************************
+  bool ChunkParser::start_pool(void)
+  {
+    uint32_t worker_cnt = this->thread_cnt - 1;
+    sigset_t signals;
+    sigset_t previous;
+    pthread_attr_t attr;
+    bool started = true;
+
+    this->pool = new Pool;
+    this->pool->tasks.resize(worker_cnt);
+    this->pool->threads.reserve(worker_cnt);
+
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+
+    for (uint32_t i = 0; i < worker_cnt && started; i++)
+    {
+      pthread_t thread;
+      Pool::Task &task = this->pool->tasks[i];
+
+      task = {this->pool, i, 0, nullptr, nullptr, 0};
+      started = (pthread_create(&thread, &attr, run_worker, &task) == 0);
+
+      if (started)
+      {
+        this->pool->threads.push_back(thread);
+      }
+    }
+
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+
+    if (!started)
+    {
+      stop_pool();
+    }
+
+    return started;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method stops and joins the worker threads, if running.
+  //
+  //*****************************************************************************
+  void ChunkParser::stop_pool(void)
+  {
+    if (!this->pool)
+    {
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(this->pool->mutex);
+      this->pool->stopping = true;
+    }
+
+    this->pool->start.notify_all();
+
+    for (pthread_t thread : this->pool->threads)
+    {
+      pthread_join(thread, nullptr);
+    }
+
+    delete this->pool;
+    this->pool = nullptr;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private static method is the body of a worker thread: it waits for
+  //  a new snapshot with a chunk for it, parses the chunk, and the last
+  //  worker to finish wakes the calling thread up.
+  //
+  //*****************************************************************************
+  void* ChunkParser::run_worker(void* context)
+  {
+    Pool::Task &task = *static_cast<Pool::Task*>(context);
+    Pool &pool = *task.pool;
+    std::unique_lock<std::mutex> lock(pool.mutex);
+
+    while (1)
+    {
+      pool.start.wait(lock, [&pool, &task]()
+      {
+        return pool.stopping || (pool.generation != task.generation && task.index < pool.active);
+      });
+
+      if (pool.stopping)
+      {
+        return nullptr;
+      }
+
+      task.generation = pool.generation;
+      lock.unlock();
+
+      task.line_cnt = parse_chunk(task.begin, task.end, pool.cpu, pool.cpu_cnt, pool.system);
+
+      lock.lock();
+
+      if (--pool.pending == 0)
+      {
+        pool.done.notify_one();
+      }
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method parses the lines of a chunk and stores their data
+  //  on the corresponding object. CPU lines with an index out of the array,
+  //  and the aggregate CPU line, are ignored.
+  //
+  //*****************************************************************************
+  uint32_t ChunkParser::parse_chunk(const char* begin, const char* end, Cpu* cpu,
+                                    uint32_t cpu_cnt, System* system)
+  {
+    Parser parser;
+    uint32_t line_cnt = 0;
+
+    while (begin < end)
+    {
+      const char* line_end = static_cast<const char*>(memchr(begin, '\n', end - begin));
+      line_end = line_end ? line_end : end;
+
+      parser.parse_line(begin, line_end);
+      uint64_t* data = parser.get_data();
+      int32_t cpu_index = parser.get_cpu_index();
+
+      switch (parser.get_label())
+      {
+        case Label::Cpu:
+          if (cpu_index >= 0 && static_cast<uint32_t>(cpu_index) < cpu_cnt)
+          {
+            cpu[cpu_index].set_data(data);
+          }
+          break;
+
+        case Label::Page:
+          system->set_page_data(data);
+          break;
+
+        case Label::Swap:
+          system->set_swap_data(data);
+          break;
+
+        case Label::Intr:
+          system->set_intr_data(data);
+          break;
+
+        case Label::Ctxt:
+          system->set_ctxt_data(data);
+          break;
+
+        case Label::Btime:
+          system->set_btime_data(data);
+          break;
+
+        default:
+          break;
+      }
+
+      line_cnt++;
+      begin = line_end + 1;
+    }
+
+    return line_cnt;
+  }
+}
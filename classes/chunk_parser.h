@@ -0,0 +1,83 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     chunk_parser.h
+//
+//*****************************************************************************
+
+#ifndef __CHUNK_PARSER_H__
+#define __CHUNK_PARSER_H__
+
+namespace procstat
+{
+  //*****************************************************************************
+  //
+  //  ChunkParser class.
+  //  This class parses a whole "/proc/stat" snapshot held in memory. Large
+  //  snapshots are split at new line boundaries into chunks that are parsed
+  //  on several threads. Each "cpuN" line is stored straight into the Cpu
+  //  object N, and each system line appears only once in the file, so the
+  //  threads never write the same object and no locks are needed. Small
+  //  snapshots are parsed on the calling thread.
+  //
+  //  The worker threads are started on the first snapshot that is split,
+  //  and then wait for the next one, so no thread is created per sample.
+  //  If they cannot be started, the snapshots are parsed on the calling
+  //  thread until the number of threads is set again.
+  //
+  //*****************************************************************************
+  class ChunkParser
+  {
+    public:
+      //
+      //  Constructor and destructor. thread_cnt is the maximum number of
+      //  threads used (0 for the number of CPUs the calling thread may run
+      //  on), and chunk_size the minimum number of bytes worth giving to a
+      //  thread. The destructor stops the worker threads.
+      //
+      ChunkParser(uint32_t thread_cnt = 0, size_t chunk_size = 65536);
+      ~ChunkParser();
+
+      //
+      //  The ChunkParser owns the worker threads, so it cannot be copied.
+      //
+      ChunkParser(const ChunkParser &) = delete;
+      ChunkParser &operator=(const ChunkParser &) = delete;
+
+      //
+      //  Setter method for the maximum number of threads (0 as in the
+      //  constructor). The running worker threads are stopped.
+      //
+      void set_thread_count(uint32_t thread_cnt);
+
+      //
+      //  Getter methods for the maximum number of threads and the number
+      //  of chunks a snapshot of a given size is split into.
+      //
+      uint32_t get_thread_count(void) const;
+      uint32_t get_chunk_count(size_t length) const;
+
+      //
+      //  Parse a snapshot, storing the CPU lines (but the aggregate one) in
+      //  the Cpu objects array, and the remaining lines in the System object.
+      //  Returns the number of lines parsed.
+      //
+      uint32_t parse(const char* data, size_t length, Cpu* cpu, uint32_t cpu_cnt,
+                     System &system);
+    private:
+      struct Pool;
+
+      uint32_t thread_cnt;
+      size_t chunk_size;
+      Pool* pool;
+
+      bool start_pool(void);
+      void stop_pool(void);
+      static void* run_worker(void* context);
+      static uint32_t parse_chunk(const char* begin, const char* end, Cpu* cpu,
+                                  uint32_t cpu_cnt, System* system);
+  };
+}
+
+#endif  // __CHUNK_PARSER_H__
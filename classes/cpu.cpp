@@ -21,15 +21,31 @@
 namespace procstat
 {
 
+  //*****************************************************************************
+  //
+  //  Constructor: Initialize the data arrays to zero, so the first interval
+  //  covers the time since boot. The CPU is offline until its line is set.
+  //
+  //*****************************************************************************
+  Cpu::Cpu() : total_cpu_time(0), interval_time(0), online(false), data {0}, delta {0}
+  {
+
+  }
+
   //*****************************************************************************
   //
   //  This method stores on the data array the time spent by the CPU on
   //  different types of processes or in idle mode, and calculates the total
-  //  CPU time.
+  //  CPU time. The difference with the previous values is stored on the
+  //  delta array to calculate the percentages since the previous sample.
   //  data[0] - user.
   //  data[1] - nice.
   //  data[2] - system.
   //  data[3] - idle.
+  //  data[4] - iowait.
+  //  data[5] - irq.
+  //  data[6] - softirq.
+  //  data[7] - steal.
   //
   //*****************************************************************************
   void Cpu::set_data(uint64_t* data)
@@ -38,10 +54,26 @@ namespace procstat
     //  Reset the total CPU time at the start of each call.
     //
     this->total_cpu_time = 0;
+    this->interval_time = 0;
+    this->online = true;
 
+    for (uint8_t i = 0; i < static_cast<uint8_t>(CpuField::Count); i++)
+    {
+      //
+      //  The counters can go backwards (e.g. a CPU brought back
+      //  online), in which case the interval is taken as empty.
+      //
+      this->delta[i] = (data[i] >= this->data[i]) ? (data[i] - this->data[i]) : 0;
+      this->data[i] = data[i];
+      this->interval_time += this->delta[i];
+    }
+
+    //
+    //  The total time since boot only accounts for
+    //  user, nice, system and idle.
+    //
     for (uint8_t i = 0; i < 4; i++)
     {
-      this->data[i] = static_cast<uint32_t>(data[i]);
       this->total_cpu_time += this->data[i];
     }
   }
@@ -52,7 +84,7 @@ namespace procstat
   //  in user mode executing normal processes.
   //
   //*****************************************************************************
-  float Cpu::get_cpu_busy_pct(void)
+  float Cpu::get_cpu_busy_pct(void) const
   {
     return (static_cast<float>(data[0]) / this->total_cpu_time) * 100;
   }
@@ -63,7 +95,7 @@ namespace procstat
   //  in user mode executing niced processes.
   //
   //*****************************************************************************
-  float Cpu::get_cpu_nice_pct(void)
+  float Cpu::get_cpu_nice_pct(void) const
   {
     return (static_cast<float>(data[1]) / this->total_cpu_time) * 100;
   }
@@ -74,7 +106,7 @@ namespace procstat
   //  kernel mode executing operating system processes.
   //
   //*****************************************************************************
-  float Cpu::get_cpu_system_pct(void)
+  float Cpu::get_cpu_system_pct(void) const
   {
     return (static_cast<float>(data[2]) / this->total_cpu_time) * 100;
   }
@@ -84,8 +116,93 @@ namespace procstat
   //  This method returns the percentage of idle times in all modes.
   //
   //*****************************************************************************
-  float Cpu::get_cpu_idle_pct(void)
+  float Cpu::get_cpu_idle_pct(void) const
   {
     return (static_cast<float>(data[3]) / this->total_cpu_time) * 100;
   }
+
+  //*****************************************************************************
+  //
+  //  This method returns the percentage of time spent in a field since the
+  //  previous sample, or zero if no time has elapsed.
+  //
+  //*****************************************************************************
+  float Cpu::get_interval_pct(CpuField field) const
+  {
+    if (this->interval_time == 0)
+    {
+      return 0;
+    }
+
+    return (static_cast<float>(this->delta[static_cast<uint8_t>(field)]) / this->interval_time) * 100;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the percentage of time spent executing any kind of
+  //  work since the previous sample, which is everything but idle and iowait.
+  //
+  //*****************************************************************************
+  float Cpu::get_interval_busy_pct(void) const
+  {
+    if (this->interval_time == 0)
+    {
+      return 0;
+    }
+
+    uint64_t waiting = this->delta[static_cast<uint8_t>(CpuField::Idle)] +
+                       this->delta[static_cast<uint8_t>(CpuField::Iowait)];
+
+    return (static_cast<float>(this->interval_time - waiting) / this->interval_time) * 100;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the time elapsed since the previous sample.
+  //
+  //*****************************************************************************
+  uint64_t Cpu::get_interval_time(void) const
+  {
+    return this->interval_time;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method empties the interval and marks the CPU offline until its
+  //  line is set again. The counters are kept, so the interval that follows
+  //  a CPU coming back online starts from its last line.
+  //
+  //*****************************************************************************
+  void Cpu::clear_interval(void)
+  {
+    this->interval_time = 0;
+    this->online = false;
+
+    for (uint8_t i = 0; i < static_cast<uint8_t>(CpuField::Count); i++)
+    {
+      this->delta[i] = 0;
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns true if the line of the CPU was set since the last
+  //  call to clear_interval.
+  //
+  //*****************************************************************************
+  bool Cpu::is_online(void) const
+  {
+    return this->online;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns a counter of the last line set, as read from the
+  //  file.
+  //
+  //*****************************************************************************
+  uint64_t Cpu::get_counter(CpuField field) const
+  {
+    return this->data[static_cast<uint8_t>(field)];
+  }
 }
@@ -15,6 +15,25 @@
 
 namespace procstat
 {
+  //*****************************************************************************
+  //
+  //  Strong type enumeration for the CPU time fields, in the same order as
+  //  they appear in the "/proc/stat" file CPU lines.
+  //
+  //*****************************************************************************
+  enum class CpuField : uint8_t
+  {
+    User,
+    Nice,
+    System,
+    Idle,
+    Iowait,
+    Irq,
+    Softirq,
+    Steal,
+    Count
+  };
+
   //*****************************************************************************
   //
   //  Cpu class.
@@ -24,6 +43,11 @@ namespace procstat
   class Cpu
   {
     public:
+      //
+      //  Constructor.
+      //
+      Cpu();
+
       //
       //  Setter method for the CPU data.
       //
@@ -36,13 +60,49 @@ namespace procstat
       //  system - processes executing in kernel mode.
       //  idle - idle times in all modes.
       //
-      float get_cpu_busy_pct(void);
-      float get_cpu_nice_pct(void);
-      float get_cpu_system_pct(void);
-      float get_cpu_idle_pct(void);
+      float get_cpu_busy_pct(void) const;
+      float get_cpu_nice_pct(void) const;
+      float get_cpu_system_pct(void) const;
+      float get_cpu_idle_pct(void) const;
+
+      //
+      //  Getter methods for the percentage of execution time since the
+      //  previous sample, for a single field and for all the non-idle
+      //  fields (everything except idle and iowait).
+      //
+      float get_interval_pct(CpuField field) const;
+      float get_interval_busy_pct(void) const;
+
+      //
+      //  Getter method for the time elapsed since the previous sample
+      //  (in USER_HZ), which is 0 if the counters did not move.
+      //
+      uint64_t get_interval_time(void) const;
+
+      //
+      //  Clear the interval before a new snapshot is parsed, so a CPU
+      //  whose line is missing from it (offline) reports no time instead
+      //  of the interval of its last line.
+      //
+      void clear_interval(void);
+
+      //
+      //  Getter method for the CPU state: true if its line was set since
+      //  the last clear_interval call.
+      //
+      bool is_online(void) const;
+
+      //
+      //  Getter method for a counter as read from the file (in USER_HZ
+      //  since boot).
+      //
+      uint64_t get_counter(CpuField field) const;
     private:
-      uint32_t total_cpu_time;
-      uint32_t data[4];
+      uint64_t total_cpu_time;
+      uint64_t interval_time;
+      bool online;
+      uint64_t data[static_cast<uint8_t>(CpuField::Count)];
+      uint64_t delta[static_cast<uint8_t>(CpuField::Count)];
   };
 }
 
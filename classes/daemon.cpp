@@ -0,0 +1,312 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     daemon.cpp
+//
+//*****************************************************************************
+//
+//  Standard string class.
+//
+#include <string>
+//
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//  C string handling functions.
+//
+#include <cstring>
+//
+//  C error numbers.
+//
+#include <cerrno>
+//
+//  Scheduling policies and CPU affinity.
+//
+#include <sched.h>
+//
+//  Process priority and resource usage.
+//
+#include <sys/resource.h>
+//
+//  Memory locking.
+//
+#include <sys/mman.h>
+//
+//
+//
+#include "cpu.h"
+#include "system.h"
+#include "parser.h"
+#include "chunk_parser.h"
+#include "sampler.h"
+#include "daemon.h"
+
+namespace procstat
+{
+  //
+  //  Period over which the CPU usage is measured, in nanoseconds.
+  //
+  static const uint64_t WINDOW_NS = 2000000000;
+
+  //
+  //  Share of the budget the floor of the sampling period aims at,
+  //  so the usage does not go back and forth across the budget.
+  //
+  static const float BUDGET_TARGET = 0.8f;
+
+  //
+  //  Highest floor set on the sampling period, so the monitor never
+  //  goes blind for longer than a minute.
+  //
+  static const uint32_t MAX_FLOOR_MS = 60000;
+
+  //*****************************************************************************
+  //
+  //  Constructor: No setting is applied and the budget is disabled.
+  //
+  //*****************************************************************************
+  Daemon::Daemon(Sampler &sampler)
+    : sampler(sampler), budget_pct(0), cost_pct(0), interval_floor_ms(0),
+      window_start(0), window_cpu_ns(0), window_samples(0), window_skipped(0)
+  {
+
+  }
+
+  //*****************************************************************************
+  //
+  //  This method restricts the calling thread to a CPU. The CPU set is
+  //  allocated for the CPU index, as hosts can have more CPUs than the
+  //  fixed size cpu_set_t holds.
+  //
+  //*****************************************************************************
+  bool Daemon::set_cpu(uint32_t cpu)
+  {
+    cpu_set_t* set = CPU_ALLOC(cpu + 1);
+    size_t size = CPU_ALLOC_SIZE(cpu + 1);
+
+    if (!set)
+    {
+      this->error = "The CPU set cannot be allocated.";
+      return false;
+    }
+
+    CPU_ZERO_S(size, set);
+    CPU_SET_S(cpu, size, set);
+
+    int result = sched_setaffinity(0, size, set);
+    CPU_FREE(set);
+
+    if (result < 0)
+    {
+      this->error = "The monitor cannot run on CPU" + std::to_string(cpu) + ": " + strerror(errno) + ".";
+      return false;
+    }
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method moves the calling thread to the SCHED_IDLE policy, which
+  //  runs it only when no normal task is runnable on its CPU.
+  //
+  //*****************************************************************************
+  bool Daemon::set_idle(void)
+  {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+
+    if (sched_setscheduler(0, SCHED_IDLE, &param) < 0)
+    {
+      this->error = std::string("The SCHED_IDLE policy cannot be set: ") + strerror(errno) + ".";
+      return false;
+    }
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method changes the nice level of the calling thread. Levels below
+  //  the current one need privileges.
+  //
+  //*****************************************************************************
+  bool Daemon::set_nice(int32_t nice)
+  {
+    if (setpriority(PRIO_PROCESS, 0, nice) < 0)
+    {
+      this->error = "The nice level cannot be set to " + std::to_string(nice) + ": " + strerror(errno) + ".";
+      return false;
+    }
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method locks the pages currently mapped by the process, including
+  //  the stacks of the parse worker threads if they are running. Future
+  //  mappings are not locked, so later allocations cannot fail on the
+  //  locked memory limit.
+  //
+  //*****************************************************************************
+  bool Daemon::lock_memory(void)
+  {
+    if (mlockall(MCL_CURRENT) < 0)
+    {
+      this->error = std::string("The memory cannot be locked (see ulimit -l): ") + strerror(errno) + ".";
+      return false;
+    }
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method changes the CPU usage budget. Disabling it removes the
+  //  floor of the sampling period.
+  //
+  //*****************************************************************************
+  void Daemon::set_budget(float budget_pct)
+  {
+    this->budget_pct = budget_pct;
+    this->window_start = 0;
+
+    if (budget_pct <= 0 && this->interval_floor_ms != 0)
+    {
+      this->interval_floor_ms = 0;
+      this->sampler.set_interval_floor(0);
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the CPU usage of the last window in percentage of
+  //  one CPU.
+  //
+  //*****************************************************************************
+  float Daemon::get_cost_pct(void) const
+  {
+    return this->cost_pct;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the floor set on the sampling period, 0 if none.
+  //
+  //*****************************************************************************
+  uint32_t Daemon::get_interval_floor(void) const
+  {
+    return this->interval_floor_ms;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the last error.
+  //
+  //*****************************************************************************
+  const std::string &Daemon::get_error(void) const
+  {
+    return this->error;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method counts the samples of the window and, once it is over,
+  //  measures the CPU usage and moves the floor of the sampling period if
+  //  the usage is over the budget or well below it. The reads skipped by
+  //  the adaptive mode cost CPU time but are not notified, so they are
+  //  counted from the sampler, and the cost is the one of a timer tick.
+  //
+  //*****************************************************************************
+  void Daemon::update(const Sample &sample)
+  {
+    if (this->budget_pct <= 0)
+    {
+      return;
+    }
+
+    //
+    //  The first window starts on the first sample, so
+    //  the start up of the monitor is not counted.
+    //
+    if (this->window_start == 0)
+    {
+      this->window_start = sample.timestamp;
+      this->window_cpu_ns = get_cpu_time();
+      this->window_samples = 0;
+      this->window_skipped = this->sampler.get_skipped_count();
+      return;
+    }
+
+    this->window_samples++;
+
+    if (sample.timestamp - this->window_start < WINDOW_NS)
+    {
+      return;
+    }
+
+    uint64_t cpu_ns = get_cpu_time();
+    uint64_t used_ns = cpu_ns - this->window_cpu_ns;
+    uint64_t skipped = this->sampler.get_skipped_count();
+    uint64_t read_cnt = this->window_samples + (skipped - this->window_skipped);
+
+    this->cost_pct = (static_cast<float>(used_ns) / (sample.timestamp - this->window_start)) * 100;
+
+    if (this->cost_pct > this->budget_pct ||
+        (this->cost_pct < this->budget_pct / 2 && this->interval_floor_ms != 0))
+    {
+      //
+      //  Period at which the cost of one read
+      //  takes the target share of the budget.
+      //
+      float sample_ns = static_cast<float>(used_ns) / read_cnt;
+      float floor_ms = sample_ns / (this->budget_pct * BUDGET_TARGET * 10000);
+
+      this->interval_floor_ms = (floor_ms >= MAX_FLOOR_MS) ? MAX_FLOOR_MS :
+                                static_cast<uint32_t>(floor_ms) + 1;
+      this->sampler.set_interval_floor(this->interval_floor_ms);
+    }
+
+    this->window_start = sample.timestamp;
+    this->window_cpu_ns = cpu_ns;
+    this->window_samples = 0;
+    this->window_skipped = skipped;
+  }
+
+  //*****************************************************************************
+  //
+  //  This static method checks the budget on a sample. The context is the
+  //  Daemon object given at subscription time.
+  //
+  //*****************************************************************************
+  void Daemon::on_sample(const Sample &sample, void* context)
+  {
+    static_cast<Daemon*>(context)->update(sample);
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method returns the CPU time (user and system) used by all
+  //  the threads of the process, in nanoseconds.
+  //
+  //*****************************************************************************
+  uint64_t Daemon::get_cpu_time(void)
+  {
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+    {
+      return 0;
+    }
+
+    return (static_cast<uint64_t>(usage.ru_utime.tv_sec) + usage.ru_stime.tv_sec) * 1000000000 +
+           (static_cast<uint64_t>(usage.ru_utime.tv_usec) + usage.ru_stime.tv_usec) * 1000;
+  }
+}
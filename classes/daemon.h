@@ -0,0 +1,94 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     daemon.h
+//
+//*****************************************************************************
+
+#ifndef __DAEMON_H__
+#define __DAEMON_H__
+
+namespace procstat
+{
+  //*****************************************************************************
+  //
+  //  Daemon class.
+  //  This class bounds the interference of the monitor with the workload of
+  //  the host. It pins the process to a housekeeping CPU, lowers its
+  //  scheduling priority, locks its memory to avoid page faults, and keeps
+  //  its CPU usage within a budget.
+  //
+  //  The scheduling settings apply to the calling thread and are inherited
+  //  by the threads it creates afterwards (e.g. the chunk parser threads),
+  //  so they must be set from the thread running the sampler.
+  //
+  //  The budget is checked every two seconds with getrusage, which counts
+  //  every thread of the process. When the CPU usage is over the budget, a
+  //  floor is set on the sampling period so the cost per read (notified or
+  //  skipped by the adaptive mode) measured over the last window fits in
+  //  80% of the budget. The floor is lowered
+  //  the same way once the usage drops below half the budget.
+  //
+  //*****************************************************************************
+  class Daemon
+  {
+    public:
+      //
+      //  Constructor.
+      //
+      Daemon(Sampler &sampler);
+
+      //
+      //  Scheduling settings: run only on a CPU, run at the SCHED_IDLE
+      //  policy (only when no other task wants the CPU), or at a nice
+      //  level. Return false on error, see get_error.
+      //
+      bool set_cpu(uint32_t cpu);
+      bool set_idle(void);
+      bool set_nice(int32_t nice);
+
+      //
+      //  Lock the pages mapped by the process in memory. It must be
+      //  called once the buffers have been allocated (e.g. after the
+      //  first sample), as later allocations are not locked. Returns
+      //  false on error, see get_error.
+      //
+      bool lock_memory(void);
+
+      //
+      //  Setter method for the CPU usage budget in percentage of one CPU
+      //  (0 for none).
+      //
+      void set_budget(float budget_pct);
+
+      //
+      //  Getter methods for the CPU usage of the last window, the floor
+      //  set on the sampling period, and the last error.
+      //
+      float get_cost_pct(void) const;
+      uint32_t get_interval_floor(void) const;
+      const std::string &get_error(void) const;
+
+      //
+      //  Check the budget on a sample. The static version can be given to
+      //  Sampler::subscribe with the daemon as context.
+      //
+      void update(const Sample &sample);
+      static void on_sample(const Sample &sample, void* context);
+    private:
+      Sampler &sampler;
+      float budget_pct;
+      float cost_pct;
+      uint32_t interval_floor_ms;
+      uint64_t window_start;
+      uint64_t window_cpu_ns;
+      uint32_t window_samples;
+      uint64_t window_skipped;
+      std::string error;
+
+      static uint64_t get_cpu_time(void);
+  };
+}
+
+#endif  // __DAEMON_H__
@@ -0,0 +1,367 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     exporter.cpp
+//
+//*****************************************************************************
+//
+//  Standard string class.
+//
+#include <string>
+//
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Atomic operations library.
+//
+#include <atomic>
+//
+//  Primitive numeric conversions.
+//
+#include <charconv>
+//
+//  C string handling functions.
+//
+#include <cstring>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//  C error numbers.
+//
+#include <cerrno>
+//
+//  POSIX operating system API for write.
+//
+#include <unistd.h>
+//
+//
+//
+#include "cpu.h"
+#include "system.h"
+#include "parser.h"
+#include "chunk_parser.h"
+#include "sampler.h"
+#include "profiler.h"
+#include "exporter.h"
+
+namespace procstat
+{
+  //
+  //  Names of the CPU fields in the order they are written.
+  //
+  static const char* const FIELD_NAMES[] =
+  {
+    "busy", "user", "nice", "system", "idle", "iowait", "irq", "softirq", "steal"
+  };
+
+  static const uint8_t FIELD_COUNT = 9;
+
+  //
+  //  Upper bounds of the formatted sizes: a percentage ("100.0") and
+  //  its separator, and a 64 bit number and its separator.
+  //
+  static const size_t PCT_SIZE = 6;
+  static const size_t UINT_SIZE = 21;
+
+  //
+  //  Maximum time in nanoseconds the formatted samples are held
+  //  in the buffer before being written.
+  //
+  static const uint64_t FLUSH_PERIOD = 1000000000;
+
+  //*****************************************************************************
+  //
+  //  Constructor: Initialize an empty layout. The buffer is reserved by the
+  //  set_cpu_count method.
+  //
+  //*****************************************************************************
+  Exporter::Exporter(Format format, int fd, size_t batch_size)
+    : format(format), fd(fd), batch_size(batch_size), cpu_cnt(0), failed(false),
+      flush_time(0), length(0)
+  {
+
+  }
+
+  //*****************************************************************************
+  //
+  //  Destructor: Write the samples still held in the buffer.
+  //
+  //*****************************************************************************
+  Exporter::~Exporter()
+  {
+    flush();
+  }
+
+  //*****************************************************************************
+  //
+  //  This method precomputes the fields layout for a number of CPUs: the CSV
+  //  header, or the JSON keys of every CPU. The buffer is sized to hold a
+  //  full batch plus the largest possible sample, so formatting never needs
+  //  to check the space left or to allocate.
+  //
+  //*****************************************************************************
+  void Exporter::set_cpu_count(uint32_t cpu_cnt)
+  {
+    this->cpu_cnt = cpu_cnt;
+    this->header.clear();
+    this->cpu_keys.clear();
+    this->cpu_key_ends.clear();
+
+    if (this->format == Format::Csv)
+    {
+      this->header = "time_ms";
+
+      for (uint32_t i = 0; i < cpu_cnt; i++)
+      {
+        for (uint8_t j = 0; j < FIELD_COUNT; j++)
+        {
+          this->header += ",cpu" + std::to_string(i) + "_" + FIELD_NAMES[j];
+        }
+      }
+
+      this->header += ",intr,ctxt\n";
+    }
+    else
+    {
+      //
+      //  All the keys are stored in a single string,
+      //  e.g. ',"cpu0":[,"cpu1":[', with the end of each
+      //  one stored apart.
+      //
+      for (uint32_t i = 0; i < cpu_cnt; i++)
+      {
+        this->cpu_keys += ",\"cpu" + std::to_string(i) + "\":[";
+        this->cpu_key_ends.push_back(static_cast<uint32_t>(this->cpu_keys.length()));
+      }
+    }
+
+    size_t sample_size = 64 + this->cpu_keys.length() +
+                         cpu_cnt * (FIELD_COUNT * PCT_SIZE + 2) + 3 * UINT_SIZE;
+
+    this->buffer.resize(this->batch_size + this->header.length() + sample_size);
+    this->length = 0;
+
+    //
+    //  The CSV header goes first in the output.
+    //
+    append(&this->buffer[0], this->header.data(), this->header.length());
+    this->length = this->header.length();
+  }
+
+  //*****************************************************************************
+  //
+  //  This method formats a sample at the end of the buffer, and writes the
+  //  buffer when it reaches the batch size or when the oldest sample in it
+  //  has been held for a second. The first sample is skipped.
+  //
+  //*****************************************************************************
+  bool Exporter::write(const Sample &sample)
+  {
+    //
+    //  The first sample has no previous one, so its
+    //  percentages are since boot and it is not written.
+    //
+    if (sample.sequence == 0)
+    {
+      return !this->failed;
+    }
+
+    uint64_t start = PROCSTAT_TICKS();
+    char* pos = &this->buffer[this->length];
+    uint32_t cpu_cnt = (sample.cpu_cnt < this->cpu_cnt) ? sample.cpu_cnt : this->cpu_cnt;
+    bool csv = (this->format == Format::Csv);
+
+    if (csv)
+    {
+      pos = append_uint(pos, sample.wall_time / 1000000);
+    }
+    else
+    {
+      pos = append(pos, "{\"time_ms\":", 11);
+      pos = append_uint(pos, sample.wall_time / 1000000);
+    }
+
+    for (uint32_t i = 0; i < cpu_cnt; i++)
+    {
+      const Cpu &cpu = sample.cpu[i];
+
+      //
+      //  Offline CPUs have empty fields in CSV
+      //  and a null array in JSON.
+      //
+      if (csv)
+      {
+        if (!cpu.is_online())
+        {
+          pos = append(pos, ",,,,,,,,,", FIELD_COUNT);
+          continue;
+        }
+
+        *pos++ = ',';
+      }
+      else
+      {
+        uint32_t begin = i ? this->cpu_key_ends[i - 1] : 0;
+
+        if (!cpu.is_online())
+        {
+          pos = append(pos, &this->cpu_keys[begin], this->cpu_key_ends[i] - begin - 1);
+          pos = append(pos, "null", 4);
+          continue;
+        }
+
+        pos = append(pos, &this->cpu_keys[begin], this->cpu_key_ends[i] - begin);
+      }
+
+      pos = append_pct(pos, cpu.get_interval_busy_pct());
+
+      for (uint8_t j = 0; j < static_cast<uint8_t>(CpuField::Count); j++)
+      {
+        *pos++ = ',';
+        pos = append_pct(pos, cpu.get_interval_pct(static_cast<CpuField>(j)));
+      }
+
+      if (!csv)
+      {
+        *pos++ = ']';
+      }
+    }
+
+    if (csv)
+    {
+      *pos++ = ',';
+      pos = append_uint(pos, sample.system->get_intr_count());
+      *pos++ = ',';
+      pos = append_uint(pos, sample.system->get_ctxt_count());
+      *pos++ = '\n';
+    }
+    else
+    {
+      pos = append(pos, ",\"intr\":", 8);
+      pos = append_uint(pos, sample.system->get_intr_count());
+      pos = append(pos, ",\"ctxt\":", 8);
+      pos = append_uint(pos, sample.system->get_ctxt_count());
+      pos = append(pos, "}\n", 2);
+    }
+
+    this->length = pos - &this->buffer[0];
+
+    if (this->flush_time == 0)
+    {
+      this->flush_time = sample.timestamp;
+    }
+
+    bool written = true;
+
+    if (this->length >= this->batch_size ||
+        (sample.timestamp - this->flush_time) >= FLUSH_PERIOD)
+    {
+      written = flush();
+      this->flush_time = sample.timestamp;
+    }
+
+    uint64_t end = PROCSTAT_TICKS();
+    PROCSTAT_RECORD(Stage::Export, start, end);
+
+    return written;
+  }
+
+  //*****************************************************************************
+  //
+  //  This static method writes a sample with the exporter given as context.
+  //  Write errors are kept in the exporter and checked with has_failed.
+  //
+  //*****************************************************************************
+  void Exporter::on_sample(const Sample &sample, void* context)
+  {
+    static_cast<Exporter*>(context)->write(sample);
+  }
+
+  //*****************************************************************************
+  //
+  //  This method writes the whole buffer to the file descriptor, retrying
+  //  on partial writes and interruptions.
+  //
+  //*****************************************************************************
+  bool Exporter::flush(void)
+  {
+    size_t offset = 0;
+
+    while (offset < this->length && !this->failed)
+    {
+      ssize_t written = ::write(this->fd, &this->buffer[offset], this->length - offset);
+
+      if (written < 0 && errno != EINTR)
+      {
+        this->failed = true;
+      }
+      else if (written > 0)
+      {
+        offset += written;
+      }
+    }
+
+    this->length = 0;
+
+    return !this->failed;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns true if a previous write failed (e.g. the reading
+  //  end of the pipe was closed).
+  //
+  //*****************************************************************************
+  bool Exporter::has_failed(void) const
+  {
+    return this->failed;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method copies a string at a buffer position, and returns
+  //  the position after it.
+  //
+  //*****************************************************************************
+  char* Exporter::append(char* pos, const char* str, size_t size)
+  {
+    memcpy(pos, str, size);
+    return pos + size;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method formats an unsigned number at a buffer position,
+  //  and returns the position after it.
+  //
+  //*****************************************************************************
+  char* Exporter::append_uint(char* pos, uint64_t value)
+  {
+    return std::to_chars(pos, pos + UINT_SIZE, value).ptr;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method formats a percentage with one decimal at a buffer
+  //  position, and returns the position after it. The value is rounded to
+  //  tenths and formatted as an integer, which avoids the floating point
+  //  formatting.
+  //
+  //*****************************************************************************
+  char* Exporter::append_pct(char* pos, float value)
+  {
+    value = (value < 0) ? 0 : ((value > 100) ? 100 : value);
+
+    uint32_t tenths = static_cast<uint32_t>(value * 10 + 0.5f);
+
+    pos = std::to_chars(pos, pos + PCT_SIZE, tenths / 10).ptr;
+    *pos++ = '.';
+    *pos++ = static_cast<char>('0' + tenths % 10);
+
+    return pos;
+  }
+}
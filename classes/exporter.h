@@ -0,0 +1,90 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     exporter.h
+//
+//*****************************************************************************
+
+#ifndef __EXPORTER_H__
+#define __EXPORTER_H__
+
+namespace procstat
+{
+  //*****************************************************************************
+  //
+  //  Strong type enumeration for the export formats.
+  //  Csv - a header row, then one row per sample.
+  //  Json - one JSON object per line and sample (JSON lines).
+  //
+  //*****************************************************************************
+  enum class Format : uint8_t
+  {
+    Csv,
+    Json
+  };
+
+  //*****************************************************************************
+  //
+  //  Exporter class.
+  //  This class writes the samples in a machine readable format. For every
+  //  CPU it writes the busy, user, nice, system, idle, iowait, irq, softirq
+  //  and steal percentages since the previous sample, followed by the
+  //  interrupts and context switches counters. The numbers are formatted
+  //  with std::to_chars into a buffer that is reserved once, and the buffer
+  //  is written to the file descriptor in large batches.
+  //
+  //*****************************************************************************
+  class Exporter
+  {
+    public:
+      //
+      //  Constructor and destructor. The destructor flushes the buffer.
+      //
+      Exporter(Format format, int fd, size_t batch_size = 65536);
+      ~Exporter();
+
+      //
+      //  Precompute the fields layout and reserve the buffer for a number
+      //  of CPUs. Must be called before the first sample.
+      //
+      void set_cpu_count(uint32_t cpu_cnt);
+
+      //
+      //  Format a sample into the buffer, and write the buffer when it
+      //  reaches the batch size or has been held for a second. The static
+      //  version can be given to Sampler::subscribe with the exporter as
+      //  context. Returns false on a write error.
+      //
+      bool write(const Sample &sample);
+      static void on_sample(const Sample &sample, void* context);
+
+      //
+      //  Write the buffer to the file descriptor.
+      //
+      bool flush(void);
+
+      //
+      //  Getter method for the write error state.
+      //
+      bool has_failed(void) const;
+    private:
+      Format format;
+      int fd;
+      size_t batch_size;
+      uint32_t cpu_cnt;
+      bool failed;
+      uint64_t flush_time;
+      std::vector<char> buffer;
+      size_t length;
+      std::string header;
+      std::string cpu_keys;
+      std::vector<uint32_t> cpu_key_ends;
+
+      static char* append(char* pos, const char* str, size_t size);
+      static char* append_uint(char* pos, uint64_t value);
+      static char* append_pct(char* pos, float value);
+  };
+}
+
+#endif  // __EXPORTER_H__
@@ -0,0 +1,496 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     heatmap.cpp
+//
+//*****************************************************************************
+//
+//  Input/output stream class to operate on files.
+//
+#include <fstream>
+//
+//  Standard string class.
+//
+#include <string>
+//
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Standard algorithms (sorting).
+//
+#include <algorithm>
+//
+//  Atomic operations library.
+//
+#include <atomic>
+//
+//  Primitive numeric conversions.
+//
+#include <charconv>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//  C error numbers.
+//
+#include <cerrno>
+//
+//  POSIX write, and terminal size control.
+//
+#include <unistd.h>
+#include <sys/ioctl.h>
+//
+//
+//
+#include "cpu.h"
+#include "system.h"
+#include "parser.h"
+#include "chunk_parser.h"
+#include "sampler.h"
+#include "profiler.h"
+#include "heatmap.h"
+
+namespace procstat
+{
+  //
+  //  256 color palette backgrounds of the busy buckets,
+  //  from dark green (0-10%) to red (90-100%).
+  //
+  static const uint8_t BUSY_COLORS[10] = {22, 28, 34, 70, 106, 142, 178, 172, 166, 160};
+  static const uint8_t OFFLINE_COLOR = 240;
+
+  //
+  //  Characters of the time split: user, growing system
+  //  shares, and iowait.
+  //
+  static const char GLYPHS[5] = {' ', '-', '=', '#', 'w'};
+  static const uint8_t GLYPH_COUNT = 5;
+
+  //
+  //  Cell states that are not a bucket and character.
+  //
+  static const uint8_t STATE_OFFLINE = 0xFF;
+  static const uint8_t STATE_NONE = 0xFE;
+
+  //
+  //  Default terminal width when the output is not a terminal.
+  //
+  static const uint16_t DEFAULT_WIDTH = 80;
+
+  //*****************************************************************************
+  //
+  //  These functions append a number, and a percentage with one decimal, to
+  //  the frame.
+  //
+  //*****************************************************************************
+  static void append_uint(std::string &frame, uint32_t value)
+  {
+    char text[12];
+    frame.append(text, std::to_chars(text, text + sizeof(text), value).ptr - text);
+  }
+
+  static void append_pct(std::string &frame, float value)
+  {
+    uint32_t tenths = static_cast<uint32_t>(value * 10 + 0.5f);
+
+    append_uint(frame, tenths / 10);
+    frame += '.';
+    frame += static_cast<char>('0' + tenths % 10);
+  }
+
+  //*****************************************************************************
+  //
+  //  This function appends a cursor move to a row and column (from 1).
+  //
+  //*****************************************************************************
+  static void append_move(std::string &frame, uint16_t row, uint16_t column)
+  {
+    frame += "\e[";
+    append_uint(frame, row);
+    frame += ';';
+    append_uint(frame, column);
+    frame += 'H';
+  }
+
+  //*****************************************************************************
+  //
+  //  This function appends a black foreground on a palette background.
+  //
+  //*****************************************************************************
+  static void append_color(std::string &frame, uint8_t color)
+  {
+    frame += "\e[30;48;5;";
+    append_uint(frame, color);
+    frame += 'm';
+  }
+
+  //*****************************************************************************
+  //
+  //  Constructor: The layout is computed by set_cpu_count.
+  //
+  //*****************************************************************************
+  Heatmap::Heatmap(int fd)
+    : fd(fd), cpu_cnt(0), drawn(false), cursor_hidden(false), failed(false), status_row(1)
+  {
+
+  }
+
+  //*****************************************************************************
+  //
+  //  Destructor: Leave the cursor below the heatmap, visible and with the
+  //  default colors.
+  //
+  //*****************************************************************************
+  Heatmap::~Heatmap()
+  {
+    if (this->cursor_hidden)
+    {
+      this->frame.clear();
+      append_move(this->frame, this->status_row + 1, 1);
+      this->frame += "\e[0m\e[?25h";
+      flush();
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This method reads the physical package (socket) of every CPU. CPUs
+  //  without topology information (e.g. offline) are put in socket 0.
+  //
+  //*****************************************************************************
+  void Heatmap::set_cpu_count(uint32_t cpu_cnt)
+  {
+    this->cpu_cnt = cpu_cnt;
+    this->sockets.assign(cpu_cnt, 0);
+
+    for (uint32_t i = 0; i < cpu_cnt; i++)
+    {
+      std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(i) +
+                         "/topology/physical_package_id");
+      int32_t socket = 0;
+
+      if (file >> socket && socket > 0)
+      {
+        this->sockets[i] = static_cast<uint32_t>(socket);
+      }
+    }
+
+    this->drawn = false;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method forces a new layout and a full redraw on the next frame.
+  //
+  //*****************************************************************************
+  void Heatmap::invalidate(void)
+  {
+    this->drawn = false;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method draws the cells that changed since the previous frame. The
+  //  cells are visited in screen order, so a cursor move is only needed
+  //  after a cell that did not change, and a color only when it differs
+  //  from the previous cell drawn. The status line is rewritten every frame.
+  //  The first sample is skipped, as its percentages are since boot.
+  //
+  //*****************************************************************************
+  bool Heatmap::render(const Sample &sample)
+  {
+    if (sample.sequence == 0 || this->failed)
+    {
+      return !this->failed;
+    }
+
+    uint64_t start = PROCSTAT_TICKS();
+    uint16_t row = 0;
+    uint16_t column = 0;
+    uint8_t color = 0;
+    bool colored = false;
+    float busy_sum = 0;
+    float busy_max = 0;
+    uint32_t online_cnt = 0;
+
+    this->frame.clear();
+
+    if (!this->drawn)
+    {
+      layout();
+      draw_static();
+      this->states.assign(this->cells.size(), STATE_NONE);
+      this->drawn = true;
+    }
+
+    for (uint32_t i = 0; i < this->cells.size(); i++)
+    {
+      const Cell &cell = this->cells[i];
+      uint8_t state = STATE_OFFLINE;
+
+      if (cell.cpu < sample.cpu_cnt)
+      {
+        const Cpu &cpu = sample.cpu[cell.cpu];
+        state = get_state(cpu);
+
+        if (state != STATE_OFFLINE)
+        {
+          float busy = cpu.get_interval_busy_pct();
+          busy_sum += busy;
+          busy_max = (busy > busy_max) ? busy : busy_max;
+          online_cnt++;
+        }
+      }
+
+      if (state == this->states[i])
+      {
+        continue;
+      }
+
+      this->states[i] = state;
+
+      if (cell.row != row || cell.column != column)
+      {
+        append_move(this->frame, cell.row, cell.column);
+      }
+
+      uint8_t cell_color = (state == STATE_OFFLINE) ? OFFLINE_COLOR : BUSY_COLORS[state / GLYPH_COUNT];
+
+      if (!colored || cell_color != color)
+      {
+        append_color(this->frame, cell_color);
+        color = cell_color;
+        colored = true;
+      }
+
+      this->frame += (state == STATE_OFFLINE) ? 'x' : GLYPHS[state % GLYPH_COUNT];
+      row = cell.row;
+      column = cell.column + 1;
+    }
+
+    //
+    //  Status line, cleared to the end of the line
+    //  as its length changes between frames.
+    //
+    append_move(this->frame, this->status_row, 1);
+    this->frame += "\e[0mAverage busy: ";
+    append_pct(this->frame, online_cnt ? (busy_sum / online_cnt) : 0);
+    this->frame += "%   Busiest CPU: ";
+    append_pct(this->frame, busy_max);
+    this->frame += "%   Online: ";
+    append_uint(this->frame, online_cnt);
+    this->frame += "/";
+    append_uint(this->frame, this->cpu_cnt);
+    this->frame += "\e[K";
+
+    this->failed = !flush();
+
+    uint64_t end = PROCSTAT_TICKS();
+    PROCSTAT_RECORD(Stage::Render, start, end);
+
+    return !this->failed;
+  }
+
+  //*****************************************************************************
+  //
+  //  This static method draws a sample with the heatmap given as context.
+  //  Write errors are kept in the heatmap and checked with has_failed.
+  //
+  //*****************************************************************************
+  void Heatmap::on_sample(const Sample &sample, void* context)
+  {
+    static_cast<Heatmap*>(context)->render(sample);
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method places the cells on the screen. Every socket has a
+  //  title row followed by rows of cells sorted by CPU index, each row
+  //  starting with the index of its first CPU. The number of cells per row
+  //  is the terminal width left by the labels, in multiples of 8.
+  //
+  //*****************************************************************************
+  void Heatmap::layout(void)
+  {
+    struct winsize size;
+    uint16_t width = DEFAULT_WIDTH;
+
+    if (ioctl(this->fd, TIOCGWINSZ, &size) == 0 && size.ws_col > 0)
+    {
+      width = size.ws_col;
+    }
+
+    uint16_t label_width = static_cast<uint16_t>(std::to_string(this->cpu_cnt ? this->cpu_cnt - 1 : 0).length() + 1);
+    uint16_t row_cells = static_cast<uint16_t>((width > label_width + 8) ? (width - label_width - 1) / 8 * 8 : 8);
+
+    std::vector<uint32_t> socket_ids(this->sockets);
+    std::sort(socket_ids.begin(), socket_ids.end());
+    socket_ids.erase(std::unique(socket_ids.begin(), socket_ids.end()), socket_ids.end());
+
+    //
+    //  Title on the first row, then the sockets.
+    //
+    uint16_t row = 3;
+
+    this->cells.clear();
+
+    for (uint32_t socket : socket_ids)
+    {
+      uint16_t column = 0;
+
+      row++;
+
+      for (uint32_t i = 0; i < this->cpu_cnt; i++)
+      {
+        if (this->sockets[i] != socket)
+        {
+          continue;
+        }
+
+        if (column == row_cells)
+        {
+          column = 0;
+          row++;
+        }
+
+        this->cells.push_back({i, row, static_cast<uint16_t>(label_width + 1 + column)});
+        column++;
+      }
+
+      row += 2;
+    }
+
+    //
+    //  Legend and status lines below the sockets.
+    //
+    this->status_row = row + 1;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method draws what does not change between frames: the
+  //  title, the socket titles, the row labels and the legend.
+  //
+  //*****************************************************************************
+  void Heatmap::draw_static(void)
+  {
+    uint32_t socket_cnt = 0;
+
+    this->frame += "\e[?25l\e[0m\e[2J\e[H";
+    this->cursor_hidden = true;
+
+    for (uint32_t i = 0; i < this->cells.size(); i++)
+    {
+      const Cell &cell = this->cells[i];
+      uint32_t socket = this->sockets[cell.cpu];
+
+      //
+      //  A socket starts with its first cell, and a row
+      //  with the first cell after the label.
+      //
+      if (i == 0 || socket != this->sockets[this->cells[i - 1].cpu])
+      {
+        append_move(this->frame, cell.row - 1, 1);
+        this->frame += "Socket ";
+        append_uint(this->frame, socket);
+        socket_cnt++;
+      }
+
+      if (i == 0 || cell.row != this->cells[i - 1].row)
+      {
+        std::string label = std::to_string(cell.cpu);
+
+        append_move(this->frame, cell.row, static_cast<uint16_t>(cell.column - label.length() - 1));
+        this->frame += label;
+      }
+    }
+
+    append_move(this->frame, 1, 1);
+    this->frame += "CPU Cores: ";
+    append_uint(this->frame, this->cpu_cnt);
+    this->frame += "   Sockets: ";
+    append_uint(this->frame, socket_cnt);
+
+    //
+    //  Legend: the busy color steps and the characters.
+    //
+    append_move(this->frame, this->status_row - 1, 1);
+    this->frame += "Busy 0% ";
+
+    for (uint8_t i = 0; i < 10; i++)
+    {
+      append_color(this->frame, BUSY_COLORS[i]);
+      this->frame += ' ';
+    }
+
+    this->frame += "\e[0m 100%   ' ' user  '-' '=' '#' system share  'w' iowait  'x' offline";
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns true if a previous frame could not be written.
+  //
+  //*****************************************************************************
+  bool Heatmap::has_failed(void) const
+  {
+    return this->failed;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method writes the frame with a single call, retrying only
+  //  on partial writes and interruptions.
+  //
+  //*****************************************************************************
+  bool Heatmap::flush(void)
+  {
+    size_t offset = 0;
+
+    while (offset < this->frame.length())
+    {
+      ssize_t written = ::write(this->fd, &this->frame[offset], this->frame.length() - offset);
+
+      if (written < 0 && errno != EINTR)
+      {
+        return false;
+      }
+      else if (written > 0)
+      {
+        offset += written;
+      }
+    }
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method computes the state of a cell: the busy bucket and
+  //  the character, or offline if the CPU line was missing from the sample.
+  //
+  //*****************************************************************************
+  uint8_t Heatmap::get_state(const Cpu &cpu)
+  {
+    if (!cpu.is_online())
+    {
+      return STATE_OFFLINE;
+    }
+
+    float busy = cpu.get_interval_busy_pct();
+    uint8_t bucket = static_cast<uint8_t>(busy / 10);
+    uint8_t glyph = 4;
+
+    bucket = (bucket > 9) ? 9 : bucket;
+
+    if (cpu.get_interval_pct(CpuField::Iowait) < 10)
+    {
+      float share = (busy > 0) ? (cpu.get_interval_pct(CpuField::System) / busy) : 0;
+      glyph = (share < 0.25f) ? 0 : ((share < 0.5f) ? 1 : ((share < 0.75f) ? 2 : 3));
+    }
+
+    return static_cast<uint8_t>(bucket * GLYPH_COUNT + glyph);
+  }
+}
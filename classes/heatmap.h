@@ -0,0 +1,90 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     heatmap.h
+//
+//*****************************************************************************
+
+#ifndef __HEATMAP_H__
+#define __HEATMAP_H__
+
+namespace procstat
+{
+  //*****************************************************************************
+  //
+  //  Heatmap class.
+  //  This class displays every CPU as a single character cell, grouped by
+  //  socket. The background color is the busy percentage in steps of 10%,
+  //  and the character tells where the time went: " " mostly user, "-",
+  //  "=" and "#" for a growing share of system time, and "w" for 10% or
+  //  more of iowait. Offline CPUs are shown as a grey "x".
+  //
+  //  The screen is drawn once, and then only the cells whose color or
+  //  character changed since the previous frame are written, with the
+  //  cursor moves and colors they need. A frame is sent with a single
+  //  write, and its size depends on the number of changed cells rather
+  //  than on the number of CPUs.
+  //
+  //*****************************************************************************
+  class Heatmap
+  {
+    public:
+      //
+      //  Constructor and destructor. The destructor restores the cursor.
+      //
+      Heatmap(int fd);
+      ~Heatmap();
+
+      //
+      //  Read the socket of every CPU from sysfs and lay the cells out for
+      //  the terminal width. Must be called before the first sample.
+      //
+      void set_cpu_count(uint32_t cpu_cnt);
+
+      //
+      //  Lay the cells out again on the next frame and redraw the whole
+      //  screen (e.g. after the terminal is resized).
+      //
+      void invalidate(void);
+
+      //
+      //  Draw the changes of a sample. The first sample is skipped, as its
+      //  percentages are since boot. The static version can be given to
+      //  Sampler::subscribe with the heatmap as context. Returns false on
+      //  a write error.
+      //
+      bool render(const Sample &sample);
+      static void on_sample(const Sample &sample, void* context);
+
+      //
+      //  Getter method for the write error state.
+      //
+      bool has_failed(void) const;
+    private:
+      struct Cell
+      {
+        uint32_t cpu;
+        uint16_t row;
+        uint16_t column;
+      };
+
+      int fd;
+      uint32_t cpu_cnt;
+      bool drawn;
+      bool cursor_hidden;
+      bool failed;
+      uint16_t status_row;
+      std::vector<uint32_t> sockets;
+      std::vector<Cell> cells;
+      std::vector<uint8_t> states;
+      std::string frame;
+
+      void layout(void);
+      void draw_static(void);
+      bool flush(void);
+      static uint8_t get_state(const Cpu &cpu);
+  };
+}
+
+#endif  // __HEATMAP_H__
@@ -0,0 +1,66 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     log_linear.h
+//
+//*****************************************************************************
+
+#ifndef __LOG_LINEAR_H__
+#define __LOG_LINEAR_H__
+
+namespace procstat
+{
+  //*****************************************************************************
+  //
+  //  LogLinear class template.
+  //  Bucket mapping shared by the Histogram and Sketch classes. Values below
+  //  2^SUB_BITS have their own bucket, above that every power of two is
+  //  split in 2^SUB_BITS linear buckets, which bounds the relative error to
+  //  1/2^SUB_BITS.
+  //
+  //*****************************************************************************
+  template <uint32_t SUB_BITS>
+  class LogLinear
+  {
+    public:
+      static const uint32_t SUB_COUNT = 1 << SUB_BITS;
+
+      //
+      //  Map a value to its bucket. Values below SUB_COUNT map to
+      //  themselves. For larger values, the position of the most
+      //  significant bit selects the group and the next SUB_BITS bits
+      //  the bucket inside it.
+      //
+      static uint32_t get_bucket(uint64_t value)
+      {
+        if (value < SUB_COUNT)
+        {
+          return static_cast<uint32_t>(value);
+        }
+
+        uint32_t msb = 63 - __builtin_clzll(value);
+        uint32_t group = msb - SUB_BITS + 1;
+
+        return (group << SUB_BITS) + static_cast<uint32_t>((value >> (group - 1)) - SUB_COUNT);
+      }
+
+      //
+      //  Return the lowest value that maps to a bucket.
+      //
+      static uint64_t get_bucket_value(uint32_t bucket)
+      {
+        if (bucket < SUB_COUNT)
+        {
+          return bucket;
+        }
+
+        uint32_t group = bucket >> SUB_BITS;
+        uint64_t offset = bucket & (SUB_COUNT - 1);
+
+        return (SUB_COUNT + offset) << (group - 1);
+      }
+  };
+}
+
+#endif  // __LOG_LINEAR_H__
@@ -10,10 +10,6 @@
 //
 //*****************************************************************************
 //
-//  Stream class to operate on strings.
-//
-#include <sstream>
-//
 //  Standard string class.
 //
 #include <string>
@@ -22,6 +18,10 @@
 //
 #include <cstdint>
 //
+//  C string handling functions.
+//
+#include <cstring>
+//
 //
 //
 #include "parser.h"
@@ -31,75 +31,117 @@ namespace procstat
 
   //*****************************************************************************
   //
-  //  Constructor: Initilize the labels array with string constants.
+  //  Constructor: Initilize the labels array with string constants. The
+  //  labels are compared by their first three characters.
   //
   //*****************************************************************************
   Parser::Parser()
-    : labels {"cpu", "pag", "swa", "int", "ctx", "btim"}
+    : label(Label::Unknown), cpu_index(-1), labels {"cpu", "pag", "swa", "int", "ctx", "bti"}
   {
 
   }
 
   //*****************************************************************************
   //
-  //  This method parses a file line into a label and data array.
+  //  This method parses a file line into a label and data array. The line is
+  //  handed to parse_line, so every access is bounded by its length and both
+  //  methods give the same result for any line.
   //
   //*****************************************************************************
   void Parser::parse_string(const std::string &line)
   {
-    uint8_t pos = 0;
-    std::string label = "";
-    std::string data = "";
+    parse_line(line.data(), line.data() + line.length());
+  }
 
-    //
-    //  Clear data buffer.
-    //
-    for (uint8_t i = 0; i < 4; i++)
+  //*****************************************************************************
+  //
+  //  This method parses a file line held in a character range into a label,
+  //  cpu index and data array, like parse_string does, but without building
+  //  any string. Every access is bounded by the end of the range.
+  //
+  //*****************************************************************************
+  void Parser::parse_line(const char* begin, const char* end)
+  {
+    const char* pos = begin;
+
+    for (uint8_t i = 0; i < DATA_COUNT; i++)
     {
       this->data[i] = 0;
     }
 
+    this->label = Label::Unknown;
+    this->cpu_index = -1;
+
     //
-    //  Get the label of the line by looping
-    //  until the first empty character.
+    //  Find the end of the label.
     //
-    while (line[pos] != ' ')
+    while (pos < end && *pos != ' ')
     {
-      label += line[pos++];
+      pos++;
     }
 
-    //
-    //  Move to the start of the data, and
-    //  build a sub-string from this position.
-    //
-    data = line.substr(++pos);
+    const char* label_end = pos;
 
     //
-    //  Store the first four values from the
-    //  current position in a data array.
+    //  Match the first three characters of the label,
+    //  and get the cpu index number that may follow them.
     //
-    std::istringstream ss(data);
-    ss >> this->data[0]
-        >> this->data[1]
-          >> this->data[2]
-            >> this->data[3];
+    if ((label_end - begin) >= 3)
+    {
+      for (uint8_t i = 0; i < 6; i++)
+      {
+        if (memcmp(begin, this->labels[i].data(), 3) == 0)
+        {
+          this->label = static_cast<Label>(i);
+        }
+      }
+    }
 
-    //
-    //  Cut the cpu index number by building a sub-string
-    //  from the first to the third character of the label.
-    //
-    label = label.substr(0, 3);
+    if (this->label == Label::Cpu && (label_end - begin) > 3 &&
+        begin[3] >= '0' && begin[3] <= '9')
+    {
+      int64_t index = 0;
+
+      for (const char* digit = begin + 3; digit < label_end && *digit >= '0' && *digit <= '9'; digit++)
+      {
+        index = (index < INT32_MAX) ? (index * 10 + (*digit - '0')) : index;
+      }
+
+      this->cpu_index = static_cast<int32_t>((index < INT32_MAX) ? index : INT32_MAX);
+    }
 
     //
-    //  Loop through the labels array to find the matching
-    //  label, then assign the corresponding value to the
-    //  enumeration label.
+    //  Store the first eight numbers separated by spaces. The
+    //  parsing stops at the first field that is not a number,
+    //  and a number too large for 64 bits is saturated.
     //
-    for (uint8_t i = 0; i < 6; i++)
+    for (uint8_t i = 0; i < DATA_COUNT; i++)
     {
-      if (label.compare(this->labels[i]) == 0)
+      while (pos < end && *pos == ' ')
+      {
+        pos++;
+      }
+
+      if (pos == end || *pos < '0' || *pos > '9')
+      {
+        break;
+      }
+
+      uint64_t value = 0;
+      bool overflow = false;
+
+      while (pos < end && *pos >= '0' && *pos <= '9')
       {
-        this->label = static_cast<Label>(i);
+        uint64_t digit = static_cast<uint64_t>(*pos++ - '0');
+        overflow |= (value > (UINT64_MAX - digit) / 10);
+        value = value * 10 + digit;
+      }
+
+      this->data[i] = overflow ? UINT64_MAX : value;
+
+      if (overflow || (pos < end && *pos != ' '))
+      {
+        break;
       }
     }
   }
@@ -115,6 +157,17 @@ namespace procstat
     return this->data;
   }
 
+  //*****************************************************************************
+  //
+  //  This method returns the cpu index number of the last file line parsed
+  //  (e.g. 3 for "cpu3"), or -1 if the line is not for a single CPU.
+  //
+  //*****************************************************************************
+  int32_t Parser::get_cpu_index()
+  {
+    return this->cpu_index;
+  }
+
   //*****************************************************************************
   //
   //  This method returns an enumeration label of the last file line parsed.
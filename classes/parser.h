@@ -28,7 +28,8 @@ namespace procstat
     Swap,
     Intr,
     Ctxt,
-    Btime
+    Btime,
+    Unknown
   };
 
   //*****************************************************************************
@@ -44,6 +45,12 @@ namespace procstat
   class Parser
   {
     public:
+      //
+      //  Number of values stored from each line. For the CPU lines these
+      //  are user, nice, system, idle, iowait, irq, softirq and steal.
+      //
+      static const uint8_t DATA_COUNT = 8;
+
       //
       //  Constructor.
       //
@@ -53,15 +60,19 @@ namespace procstat
       //  Getter methods for the file line elements.
       //
       enum Label get_label();
+      int32_t get_cpu_index();
       uint64_t* get_data();
 
       //
-      //  String parser method.
+      //  String parser method, and the equivalent method for a line held
+      //  in a character range (without the new line character).
       //
       void parse_string(const std::string &line);
+      void parse_line(const char* begin, const char* end);
     private:
       Label label;
-      uint64_t data[4];
+      int32_t cpu_index;
+      uint64_t data[DATA_COUNT];
       const std::string labels[6];
   };
 }
@@ -0,0 +1,343 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     profiler.cpp
+//
+//*****************************************************************************
+//
+//  Standard output streams library.
+//
+#include <ostream>
+//
+//  Header providing parametric manipulators.
+//
+#include <iomanip>
+//
+//  Atomic operations library.
+//
+#include <atomic>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//  POSIX clocks and resource usage.
+//
+#include <time.h>
+#include <sys/resource.h>
+//
+//  Time stamp counter intrinsic.
+//
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+//
+//
+//
+#include "log_linear.h"
+#include "profiler.h"
+
+namespace procstat
+{
+  //
+  //  Process wide profiler instance.
+  //
+  Profiler profiler;
+
+  //
+  //  Stage names, in the same order as the Stage enumeration.
+  //
+  static const char* const STAGE_NAMES[] = {"read", "parse", "compute", "rules", "render", "export"};
+
+  //*****************************************************************************
+  //
+  //  Constructor: Initialize all the counters to zero.
+  //
+  //*****************************************************************************
+  Histogram::Histogram() : count(0), sum(0), max(0)
+  {
+    for (uint32_t i = 0; i < BUCKETS; i++)
+    {
+      this->counts[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This method records a value. Only relaxed atomic operations are used,
+  //  the maximum is updated with a compare and swap loop that only spins
+  //  when another thread is recording a larger value at the same time.
+  //
+  //*****************************************************************************
+  void Histogram::record(uint64_t value)
+  {
+    this->counts[LogLinear<SUB_BITS>::get_bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    this->count.fetch_add(1, std::memory_order_relaxed);
+    this->sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t current = this->max.load(std::memory_order_relaxed);
+
+    while (value > current &&
+           !this->max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  These methods return the number of values recorded, their sum and the
+  //  maximum value recorded.
+  //
+  //*****************************************************************************
+  uint64_t Histogram::get_count(void) const
+  {
+    return this->count.load(std::memory_order_relaxed);
+  }
+
+  uint64_t Histogram::get_sum(void) const
+  {
+    return this->sum.load(std::memory_order_relaxed);
+  }
+
+  uint64_t Histogram::get_max(void) const
+  {
+    return this->max.load(std::memory_order_relaxed);
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the lower bound of the bucket holding the value at
+  //  the given percentile (0 to 100), or zero if nothing was recorded.
+  //
+  //*****************************************************************************
+  uint64_t Histogram::get_percentile(double pct) const
+  {
+    uint64_t total = get_count();
+    uint64_t target = static_cast<uint64_t>((pct / 100) * total);
+    uint64_t seen = 0;
+
+    if (total == 0)
+    {
+      return 0;
+    }
+
+    if (target >= total)
+    {
+      target = total - 1;
+    }
+
+    for (uint32_t i = 0; i < BUCKETS; i++)
+    {
+      seen += this->counts[i].load(std::memory_order_relaxed);
+
+      if (seen > target)
+      {
+        return LogLinear<SUB_BITS>::get_bucket_value(i);
+      }
+    }
+
+    return get_max();
+  }
+
+  //*****************************************************************************
+  //
+  //  Constructor: Take the reference points for the ticks to nanoseconds
+  //  conversion and measure the cost of a probe (one tick read and one
+  //  record), which is used to estimate the instrumentation overhead.
+  //
+  //*****************************************************************************
+  Profiler::Profiler()
+    : probes(0), start_ticks(ticks()), start_ns(monotonic_ns()), record_cost_ns(0)
+  {
+    const uint32_t rounds = 1000;
+    Histogram scratch;
+    uint64_t begin = monotonic_ns();
+
+    for (uint32_t i = 0; i < rounds; i++)
+    {
+      scratch.record(ticks());
+    }
+
+    this->record_cost_ns = static_cast<double>(monotonic_ns() - begin) / rounds;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the current time in ticks. On x86 it reads the time
+  //  stamp counter, elsewhere it reads CLOCK_MONOTONIC in nanoseconds.
+  //
+  //*****************************************************************************
+  uint64_t Profiler::ticks(void)
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return monotonic_ns();
+#endif
+  }
+
+  //*****************************************************************************
+  //
+  //  This method records the duration in ticks of a stage, and the number
+  //  of probes used to measure it.
+  //
+  //*****************************************************************************
+  void Profiler::record(Stage stage, uint64_t duration, uint64_t probes)
+  {
+    this->histograms[static_cast<uint8_t>(stage)].record(duration);
+    this->probes.fetch_add(probes, std::memory_order_relaxed);
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the latency histogram of a stage.
+  //
+  //*****************************************************************************
+  const Histogram &Profiler::get_histogram(Stage stage) const
+  {
+    return this->histograms[static_cast<uint8_t>(stage)];
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the ticks to nanoseconds conversion factor, based
+  //  on the ticks and nanoseconds elapsed since the profiler was created.
+  //
+  //*****************************************************************************
+  double Profiler::get_ns_per_tick(void) const
+  {
+    uint64_t elapsed_ticks = ticks() - this->start_ticks;
+    uint64_t elapsed_ns = monotonic_ns() - this->start_ns;
+
+    if (elapsed_ticks == 0)
+    {
+      return 1;
+    }
+
+    return static_cast<double>(elapsed_ns) / elapsed_ticks;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the CPU time (user and system) used by the process
+  //  since start, as a percentage of the elapsed wall time.
+  //
+  //*****************************************************************************
+  double Profiler::get_cpu_usage_pct(void) const
+  {
+    struct rusage usage;
+    uint64_t elapsed_ns = monotonic_ns() - this->start_ns;
+
+    if (getrusage(RUSAGE_SELF, &usage) < 0 || elapsed_ns == 0)
+    {
+      return 0;
+    }
+
+    double cpu_ns = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e9 +
+                    (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e3;
+
+    return (cpu_ns / elapsed_ns) * 100;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the estimated percentage of the process CPU time
+  //  spent on the probes, based on the number of probes taken and the
+  //  cost of a probe measured by the constructor.
+  //
+  //*****************************************************************************
+  double Profiler::get_overhead_pct(void) const
+  {
+    double elapsed_ns = static_cast<double>(monotonic_ns() - this->start_ns);
+    double cpu_ns = (get_cpu_usage_pct() / 100) * elapsed_ns;
+
+    if (cpu_ns == 0)
+    {
+      return 0;
+    }
+
+    return ((this->probes.load(std::memory_order_relaxed) * this->record_cost_ns) / cpu_ns) * 100;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method prints the self statistics panel: the count, median, 99th
+  //  percentile and maximum latency of each stage in microseconds, the CPU
+  //  usage of the process and the instrumentation overhead.
+  //
+  //*****************************************************************************
+  void Profiler::print_panel(std::ostream &os) const
+  {
+    double us_per_tick = get_ns_per_tick() / 1000;
+
+    os << std::left << std::setw(8) << "Stage";
+    os << std::setw(12) << std::right << "Count";
+    os << std::setw(12) << std::right << "p50 (us)";
+    os << std::setw(11) << std::right << "p99 (us)";
+    os << std::setw(12) << std::right << "Max (us)" << std::endl;
+    os << "=======================================================" << std::endl;
+
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Stage::Count); i++)
+    {
+      const Histogram &histogram = this->histograms[i];
+
+      os << std::setprecision(1) << std::fixed;
+      os << std::left << std::setw(8) << STAGE_NAMES[i];
+      os << std::setw(12) << std::right << histogram.get_count();
+      os << std::setw(12) << std::right << histogram.get_percentile(50) * us_per_tick;
+      os << std::setw(11) << std::right << histogram.get_percentile(99) * us_per_tick;
+      os << std::setw(12) << std::right << histogram.get_max() * us_per_tick << std::endl;
+    }
+
+    os << "-------------------------------------------------------" << std::endl;
+    os << std::setprecision(3) << std::fixed;
+    os << std::left << "Monitor CPU usage: " << get_cpu_usage_pct() << "%" << std::endl;
+    os << "Instrumentation overhead: " << get_overhead_pct() << "%" << std::endl;
+    os << "-------------------------------------------------------" << std::endl;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method prints the self statistics as a single-line JSON object,
+  //  with the stage latencies in nanoseconds.
+  //
+  //*****************************************************************************
+  void Profiler::print_json(std::ostream &os) const
+  {
+    double ns_per_tick = get_ns_per_tick();
+
+    os << "{\"stages\":{";
+
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Stage::Count); i++)
+    {
+      const Histogram &histogram = this->histograms[i];
+
+      os << (i ? "," : "") << "\"" << STAGE_NAMES[i] << "\":{";
+      os << "\"count\":" << histogram.get_count();
+      os << ",\"p50_ns\":" << static_cast<uint64_t>(histogram.get_percentile(50) * ns_per_tick);
+      os << ",\"p99_ns\":" << static_cast<uint64_t>(histogram.get_percentile(99) * ns_per_tick);
+      os << ",\"max_ns\":" << static_cast<uint64_t>(histogram.get_max() * ns_per_tick);
+      os << "}";
+    }
+
+    os << std::setprecision(3) << std::fixed;
+    os << "},\"cpu_pct\":" << get_cpu_usage_pct();
+    os << ",\"overhead_pct\":" << get_overhead_pct() << "}" << std::endl;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method returns CLOCK_MONOTONIC in nanoseconds.
+  //
+  //*****************************************************************************
+  uint64_t Profiler::monotonic_ns(void)
+  {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+  }
+}
@@ -0,0 +1,153 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     profiler.h
+//
+//*****************************************************************************
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+//
+//  Compile-time switch for the self instrumentation. Build with
+//  -DPROCSTAT_SELF_STATS=0 to remove every probe from the hot path.
+//
+#ifndef PROCSTAT_SELF_STATS
+#define PROCSTAT_SELF_STATS 1
+#endif
+
+//
+//  PROCSTAT_RECORD records the ticks between two probes.
+//
+#if PROCSTAT_SELF_STATS
+#define PROCSTAT_TICKS() procstat::Profiler::ticks()
+#define PROCSTAT_RECORD(stage, start, end) \
+  procstat::profiler.record((stage), (end) - (start), 1)
+#else
+#define PROCSTAT_TICKS() 0
+#define PROCSTAT_RECORD(stage, start, end) ((void)(start), (void)(end))
+#endif
+
+namespace procstat
+{
+  //*****************************************************************************
+  //
+  //  Strong type enumeration for the instrumented stages of a sample.
+  //
+  //*****************************************************************************
+  enum class Stage : uint8_t
+  {
+    Read,
+    Parse,
+    Compute,
+    Rules,
+    Render,
+    Export,
+    Count
+  };
+
+  //*****************************************************************************
+  //
+  //  Histogram class.
+  //  Lock-free log-linear histogram (see LogLinear) with 16 buckets per
+  //  power of two, which bounds the relative error to 1/16. Recording is
+  //  a relaxed atomic increment, so a reader on another thread never blocks
+  //  the writer.
+  //
+  //*****************************************************************************
+  class Histogram
+  {
+    public:
+      static const uint32_t SUB_BITS = 4;
+      static const uint32_t SUB_COUNT = 1 << SUB_BITS;
+      static const uint32_t BUCKETS = (65 - SUB_BITS) * SUB_COUNT;
+
+      //
+      //  Constructor.
+      //
+      Histogram();
+
+      //
+      //  Method to record a value.
+      //
+      void record(uint64_t value);
+
+      //
+      //  Getter methods for the number of values recorded, their sum,
+      //  the maximum value and the value at a percentile (0 to 100).
+      //
+      uint64_t get_count(void) const;
+      uint64_t get_sum(void) const;
+      uint64_t get_max(void) const;
+      uint64_t get_percentile(double pct) const;
+    private:
+      std::atomic<uint64_t> counts[BUCKETS];
+      std::atomic<uint64_t> count;
+      std::atomic<uint64_t> sum;
+      std::atomic<uint64_t> max;
+  };
+
+  //*****************************************************************************
+  //
+  //  Profiler class.
+  //  This class collects the latency of each stage of a sample and the CPU
+  //  time used by the process. The stages are timed with the time stamp
+  //  counter when available, and CLOCK_MONOTONIC otherwise.
+  //
+  //*****************************************************************************
+  class Profiler
+  {
+    public:
+      //
+      //  Constructor.
+      //
+      Profiler();
+
+      //
+      //  Method to read the current time in ticks.
+      //
+      static uint64_t ticks(void);
+
+      //
+      //  Method to record the duration in ticks of a stage, and the
+      //  number of probes used to measure it.
+      //
+      void record(Stage stage, uint64_t duration, uint64_t probes);
+
+      //
+      //  Getter method for the latency histogram of a stage.
+      //
+      const Histogram &get_histogram(Stage stage) const;
+
+      //
+      //  Getter methods for the ticks to nanoseconds conversion factor,
+      //  the CPU usage of the process since start in percentage, and the
+      //  estimated percentage of that CPU time spent on instrumentation.
+      //
+      double get_ns_per_tick(void) const;
+      double get_cpu_usage_pct(void) const;
+      double get_overhead_pct(void) const;
+
+      //
+      //  Output methods for the self statistics panel, and for a
+      //  single-line JSON object to be exported.
+      //
+      void print_panel(std::ostream &os) const;
+      void print_json(std::ostream &os) const;
+    private:
+      Histogram histograms[static_cast<uint8_t>(Stage::Count)];
+      std::atomic<uint64_t> probes;
+      uint64_t start_ticks;
+      uint64_t start_ns;
+      double record_cost_ns;
+      static uint64_t monotonic_ns(void);
+  };
+
+  //
+  //  Process wide profiler instance used by the probes.
+  //
+  extern Profiler profiler;
+}
+
+#endif  // __PROFILER_H__
@@ -0,0 +1,685 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     rules.cpp
+//
+//*****************************************************************************
+//
+//  Input/output stream class to operate on files.
+//
+#include <fstream>
+//
+//  Stream class to operate on strings.
+//
+#include <sstream>
+//
+//  Header providing parametric manipulators.
+//
+#include <iomanip>
+//
+//  Standard string class.
+//
+#include <string>
+//
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Atomic operations library.
+//
+#include <atomic>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//  C standard general utilities library.
+//
+#include <cstdlib>
+//
+//  C numerics library.
+//
+#include <cmath>
+//
+//  Numeric limits of the arithmetic types.
+//
+#include <limits>
+//
+//
+//
+#include "cpu.h"
+#include "system.h"
+#include "parser.h"
+#include "chunk_parser.h"
+#include "sampler.h"
+#include "profiler.h"
+#include "rules.h"
+
+namespace procstat
+{
+  //
+  //  Metric names, in the same order as the Metric enumeration.
+  //
+  static const char* const METRIC_NAMES[] =
+  {
+    "user", "nice", "system", "idle", "iowait", "irq", "softirq", "steal",
+    "busy", "intr_rate", "ctxt_rate"
+  };
+
+  //
+  //  Default window in seconds for the relative thresholds.
+  //
+  static const float DEFAULT_WINDOW = 60;
+
+  //
+  //  Held time of a target whose condition is not met.
+  //
+  static const float NOT_HELD = -std::numeric_limits<float>::infinity();
+
+  //*****************************************************************************
+  //
+  //  This function parses a threshold, either a plain number or a factor of
+  //  the mean ("<factor>xmean"), into its absolute and relative parts.
+  //  Returns false if the string is not a valid threshold.
+  //
+  //*****************************************************************************
+  static bool parse_threshold(const std::string &str, float &abs, float &rel)
+  {
+    char* end = nullptr;
+    float value = std::strtof(str.c_str(), &end);
+
+    if (end == str.c_str() || !std::isfinite(value))
+    {
+      return false;
+    }
+
+    if (*end == '\0')
+    {
+      abs = value;
+      rel = 0;
+      return true;
+    }
+
+    if (std::string(end) == "xmean")
+    {
+      abs = 0;
+      rel = value;
+      return true;
+    }
+
+    return false;
+  }
+
+  //*****************************************************************************
+  //
+  //  Constructor: Initialize an empty program writing to no output.
+  //
+  //*****************************************************************************
+  RuleEngine::RuleEngine()
+    : cpu_cnt(0), output(nullptr), state_cnt(0), target_cnt(0), seeded(false), last_timestamp(0),
+      last_intr(0), last_ctxt(0)
+  {
+
+  }
+
+  //*****************************************************************************
+  //
+  //  This method reads the rules file line by line, compiling each rule into
+  //  one instruction per target. The metrics table and evaluation state are
+  //  allocated here, so no allocations are done while evaluating.
+  //
+  //*****************************************************************************
+  bool RuleEngine::load(const std::string &path, uint32_t cpu_cnt)
+  {
+    std::ifstream fs(path);
+    std::string line;
+    uint32_t line_num = 0;
+
+    this->cpu_cnt = cpu_cnt;
+    this->names.clear();
+    this->program.clear();
+    this->state_cnt = 0;
+    this->target_cnt = 0;
+    this->seeded = false;
+    this->last_timestamp = 0;
+
+    if (!fs.is_open())
+    {
+      this->error = "cannot open " + path;
+      return false;
+    }
+
+    while (getline(fs, line))
+    {
+      if (!compile_line(line, ++line_num))
+      {
+        return false;
+      }
+    }
+
+    //
+    //  One row of metrics per CPU, plus one row for the system, stored
+    //  by metric, and a block of padding so the last block of every
+    //  instruction can be read whole. The states of every instruction
+    //  are padded to whole blocks too.
+    //
+    this->table.assign((this->cpu_cnt + 1) * COLUMNS + BLOCK, 0);
+    this->held.assign(this->state_cnt, NOT_HELD);
+    this->means.assign(this->state_cnt, 0);
+    this->active.assign(this->state_cnt, 0);
+    this->online.assign(this->cpu_cnt + 1 + BLOCK, 1);
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the description of the last load error.
+  //
+  //*****************************************************************************
+  const std::string &RuleEngine::get_error(void) const
+  {
+    return this->error;
+  }
+
+  //*****************************************************************************
+  //
+  //  These methods return the number of rules loaded and the number of
+  //  targets they were expanded to.
+  //
+  //*****************************************************************************
+  uint32_t RuleEngine::get_rule_count(void) const
+  {
+    return static_cast<uint32_t>(this->names.size());
+  }
+
+  uint32_t RuleEngine::get_target_count(void) const
+  {
+    return this->target_cnt;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method sets the stream where the events are written. A null
+  //  pointer disables the output.
+  //
+  //*****************************************************************************
+  void RuleEngine::set_output(std::ostream* os)
+  {
+    this->output = os;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method computes the metrics table and runs the program over it.
+  //  The span of targets of every instruction is walked in blocks, which
+  //  are first compared with their thresholds, and have their held times
+  //  and means updated, by vectorized loops. Only the targets flagged by
+  //  the compare are then visited, to raise or clear the rule.
+  //
+  //*****************************************************************************
+  void RuleEngine::evaluate(const Sample &sample)
+  {
+    uint64_t start = PROCSTAT_TICKS();
+
+    compute_table(sample);
+
+    uint64_t computed = PROCSTAT_TICKS();
+    PROCSTAT_RECORD(Stage::Compute, start, computed);
+
+    //
+    //  The first sample has no previous one to compute the intervals and
+    //  rates from, so it is only used as reference. The means are seeded
+    //  with the second sample, and then follow an exponential moving
+    //  average with the given window.
+    //
+    if (this->last_timestamp == 0)
+    {
+      this->last_timestamp = sample.timestamp;
+      return;
+    }
+
+    bool first = !this->seeded;
+    bool flush = false;
+    float elapsed = (sample.timestamp - this->last_timestamp) / 1e9f;
+    uint32_t rows = this->cpu_cnt + 1;
+
+    for (const Instruction &instruction : this->program)
+    {
+      bool relative = (instruction.raise_rel != 0) || (instruction.clear_rel != 0);
+      float alpha = elapsed * instruction.inv_window;
+      alpha = (alpha > 1) ? 1 : alpha;
+
+      for (uint32_t j = 0; j < instruction.count; j += BLOCK)
+      {
+        uint32_t count = instruction.count - j;
+        const float* values = &this->table[instruction.value_idx + j];
+        const uint32_t* online = &this->online[instruction.value_idx % rows + j];
+        float* held = &this->held[instruction.state_idx + j];
+        float* means = &this->means[instruction.state_idx + j];
+        uint32_t* active = &this->active[instruction.state_idx + j];
+        uint32_t flags[BLOCK];
+
+        //
+        //  The thresholds are taken against the means, or the values
+        //  themselves for absolute rules and on the first sample.
+        //
+        bool changed = find_changes(instruction, values, (relative && !first) ? means : values,
+                                    online, count, active, flags);
+
+        if (instruction.duration > 0)
+        {
+          reset_held(online, flags, held);
+        }
+
+        if (relative)
+        {
+          update_means(values, online, first ? 1 : alpha, means);
+        }
+
+        if (!changed)
+        {
+          continue;
+        }
+
+        //
+        //  Only the few targets whose condition does not match their
+        //  state are walked: an active one is cleared, an inactive one
+        //  is raised once its condition has held for the duration. The
+        //  held time is counted from zero on the first sample that
+        //  meets the condition.
+        //
+        count = (count < BLOCK) ? count : BLOCK;
+
+        for (uint32_t k = 0; k < count; k++)
+        {
+          if (!flags[k])
+          {
+            continue;
+          }
+
+          float time = (held[k] + elapsed > 0) ? held[k] + elapsed : 0;
+
+          if (!active[k] && time < instruction.duration)
+          {
+            held[k] = time;
+            continue;
+          }
+
+          active[k] ^= 1;
+          held[k] = NOT_HELD;
+          emit(instruction, j + k, values[k], active[k], sample);
+          flush = true;
+        }
+      }
+    }
+
+    if (flush && this->output)
+    {
+      this->output->flush();
+    }
+
+    this->last_timestamp = sample.timestamp;
+    this->seeded = true;
+
+    uint64_t end = PROCSTAT_TICKS();
+    PROCSTAT_RECORD(Stage::Rules, computed, end);
+  }
+
+  //*****************************************************************************
+  //
+  //  This static method evaluates the rules of the engine given as context.
+  //
+  //*****************************************************************************
+  void RuleEngine::on_sample(const Sample &sample, void* context)
+  {
+    static_cast<RuleEngine*>(context)->evaluate(sample);
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method compiles a configuration line. Returns false and
+  //  sets the error description if the line is not a valid rule.
+  //
+  //*****************************************************************************
+  bool RuleEngine::compile_line(const std::string &line, uint32_t line_num)
+  {
+    std::istringstream ss(line);
+    std::string name, target, metric, op, threshold, clear, key, value;
+    std::string prefix = "line " + std::to_string(line_num) + ": ";
+    Instruction instruction;
+    uint8_t metric_idx = 0;
+
+    if (!(ss >> name) || name[0] == '#')
+    {
+      return true;
+    }
+
+    if (!(ss >> target >> metric >> op >> threshold))
+    {
+      this->error = prefix + "expected <name> <target> <metric> <op> <threshold>";
+      return false;
+    }
+
+    //
+    //  Find the metric index.
+    //
+    while (metric_idx < COLUMNS && metric.compare(METRIC_NAMES[metric_idx]) != 0)
+    {
+      metric_idx++;
+    }
+
+    if (metric_idx == COLUMNS)
+    {
+      this->error = prefix + "unknown metric '" + metric + "'";
+      return false;
+    }
+
+    if (op != ">" && op != "<")
+    {
+      this->error = prefix + "unknown operator '" + op + "'";
+      return false;
+    }
+
+    if (!parse_threshold(threshold, instruction.raise_abs, instruction.raise_rel))
+    {
+      this->error = prefix + "invalid threshold '" + threshold + "'";
+      return false;
+    }
+
+    instruction.rule_idx = static_cast<uint32_t>(this->names.size());
+    instruction.sign = (op == ">") ? 1 : -1;
+    instruction.clear_abs = instruction.raise_abs;
+    instruction.clear_rel = instruction.raise_rel;
+    instruction.inv_window = 1 / DEFAULT_WINDOW;
+    instruction.duration = 0;
+
+    //
+    //  Optional key and value pairs.
+    //
+    while (ss >> key)
+    {
+      char* end = nullptr;
+
+      if (!(ss >> value))
+      {
+        this->error = prefix + "missing value for '" + key + "'";
+        return false;
+      }
+
+      if (key == "for")
+      {
+        instruction.duration = std::strtof(value.c_str(), &end);
+
+        if (!(instruction.duration >= 0) || std::isinf(instruction.duration))
+        {
+          this->error = prefix + "invalid duration '" + value + "'";
+          return false;
+        }
+      }
+      else if (key == "window")
+      {
+        float window = std::strtof(value.c_str(), &end);
+
+        if (!(window > 0) || std::isinf(window))
+        {
+          this->error = prefix + "invalid window '" + value + "'";
+          return false;
+        }
+
+        instruction.inv_window = 1 / window;
+      }
+      else if (key == "clear")
+      {
+        if (!parse_threshold(value, instruction.clear_abs, instruction.clear_rel))
+        {
+          this->error = prefix + "invalid clear value '" + value + "'";
+          return false;
+        }
+        clear = value;
+        end = &value[value.length()];
+      }
+      else
+      {
+        this->error = prefix + "unknown option '" + key + "'";
+        return false;
+      }
+
+      if (end == value.c_str() || *end != '\0')
+      {
+        this->error = prefix + "invalid value '" + value + "'";
+        return false;
+      }
+    }
+
+    //
+    //  Fold the sign into the thresholds, so "<" rules
+    //  are evaluated as "-value > -threshold".
+    //
+    instruction.raise_abs *= instruction.sign;
+    instruction.raise_rel *= instruction.sign;
+    instruction.clear_abs *= instruction.sign;
+    instruction.clear_rel *= instruction.sign;
+
+    //
+    //  The rule is cleared when the value crosses back the clear
+    //  threshold, so it must not be past the raise threshold, or the
+    //  rule would flip on every sample. Absolute and relative
+    //  thresholds cannot be ordered before the means are known.
+    //
+    if ((instruction.raise_rel == 0) == (instruction.clear_rel == 0) &&
+        (instruction.clear_abs > instruction.raise_abs || instruction.clear_rel > instruction.raise_rel))
+    {
+      this->error = prefix + "clear value '" + clear + "' is past the threshold '" + threshold + "'";
+      return false;
+    }
+
+    //
+    //  Find the span of targets covered by the rule.
+    //
+    bool system_metric = (metric_idx >= static_cast<uint8_t>(Metric::IntrRate));
+    uint32_t rows = this->cpu_cnt + 1;
+
+    if (target == "system" && system_metric)
+    {
+      instruction.first_target = -1;
+      instruction.value_idx = metric_idx * rows + this->cpu_cnt;
+      instruction.count = 1;
+    }
+    else if (target.compare(0, 3, "cpu") == 0 && !system_metric)
+    {
+      uint32_t first = 0;
+      uint32_t count = this->cpu_cnt;
+
+      if (target != "cpu*")
+      {
+        char* end = nullptr;
+        first = static_cast<uint32_t>(std::strtoul(target.c_str() + 3, &end, 10));
+        count = 1;
+
+        if (end == target.c_str() + 3 || *end != '\0' || first >= this->cpu_cnt)
+        {
+          this->error = prefix + "unknown target '" + target + "'";
+          return false;
+        }
+      }
+
+      instruction.first_target = static_cast<int32_t>(first);
+      instruction.value_idx = metric_idx * rows + first;
+      instruction.count = count;
+    }
+    else
+    {
+      this->error = prefix + "invalid target '" + target + "' for metric '" + metric + "'";
+      return false;
+    }
+
+    instruction.state_idx = this->state_cnt;
+    this->state_cnt += (instruction.count + BLOCK - 1) / BLOCK * BLOCK;
+    this->target_cnt += instruction.count;
+    this->program.push_back(instruction);
+    this->names.push_back(name);
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private static method compares a block of targets of an
+  //  instruction with the threshold that applies to their state, the raise
+  //  one for the inactive targets and the clear one for the active ones,
+  //  and sets the flag of the online targets whose condition does not
+  //  match their state. The loop has a fixed count, no branches and no
+  //  aliasing pointers, so the compiler vectorizes it. The states are
+  //  padded to whole blocks, and the lanes past the count are never set.
+  //  Returns true if any flag is set.
+  //
+  //*****************************************************************************
+  bool RuleEngine::find_changes(const Instruction &instruction, const float* __restrict values,
+                                const float* __restrict bases, const uint32_t* __restrict online,
+                                uint32_t count, const uint32_t* __restrict active,
+                                uint32_t* __restrict flags)
+  {
+    const float sign = instruction.sign;
+    const float raise_abs = instruction.raise_abs;
+    const float raise_rel = instruction.raise_rel;
+    const float clear_abs = instruction.clear_abs;
+    const float clear_rel = instruction.clear_rel;
+    uint32_t changed = 0;
+
+    for (uint32_t k = 0; k < BLOCK; k++)
+    {
+      float value = sign * values[k];
+      uint32_t on = active[k];
+      uint32_t over_raise = value > raise_abs + raise_rel * bases[k];
+      uint32_t over_clear = value > clear_abs + clear_rel * bases[k];
+      uint32_t over = (on & over_clear) | ((on ^ 1) & over_raise);
+      uint32_t flag = online[k] & (k < count) & (over ^ on);
+
+      flags[k] = flag;
+      changed |= flag;
+    }
+
+    return changed != 0;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private static method resets the held time of the online targets
+  //  of a block whose condition matches their state, so it starts from zero
+  //  the next time the condition is met. Offline targets keep their time.
+  //
+  //*****************************************************************************
+  void RuleEngine::reset_held(const uint32_t* __restrict online, const uint32_t* __restrict flags,
+                              float* __restrict held)
+  {
+    for (uint32_t k = 0; k < BLOCK; k++)
+    {
+      held[k] = (flags[k] | (online[k] ^ 1)) ? held[k] : NOT_HELD;
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This private static method moves the means of a block of targets
+  //  towards their values. The offline targets keep their means.
+  //
+  //*****************************************************************************
+  void RuleEngine::update_means(const float* __restrict values, const uint32_t* __restrict online,
+                                float alpha, float* __restrict means)
+  {
+    for (uint32_t k = 0; k < BLOCK; k++)
+    {
+      float weight = online[k] ? alpha : 0.0f;
+      means[k] += weight * (values[k] - means[k]);
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method fills the metrics table: one row per CPU with the
+  //  percentages since the previous sample, and a last row with the system
+  //  rates per second. The table is stored by metric (column-major). The
+  //  online flag of every row is kept apart, the system row is always on.
+  //
+  //*****************************************************************************
+  void RuleEngine::compute_table(const Sample &sample)
+  {
+    uint32_t rows = this->cpu_cnt + 1;
+    uint32_t cpu_cnt = (sample.cpu_cnt < this->cpu_cnt) ? sample.cpu_cnt : this->cpu_cnt;
+
+    for (uint8_t j = 0; j < static_cast<uint8_t>(CpuField::Count); j++)
+    {
+      float* column = &this->table[j * rows];
+
+      for (uint32_t i = 0; i < cpu_cnt; i++)
+      {
+        column[i] = sample.cpu[i].get_interval_pct(static_cast<CpuField>(j));
+      }
+    }
+
+    float* column = &this->table[static_cast<uint8_t>(Metric::Busy) * rows];
+
+    for (uint32_t i = 0; i < cpu_cnt; i++)
+    {
+      column[i] = sample.cpu[i].get_interval_busy_pct();
+      this->online[i] = sample.cpu[i].is_online();
+    }
+
+    for (uint32_t i = cpu_cnt; i < this->cpu_cnt; i++)
+    {
+      this->online[i] = 0;
+    }
+
+    uint64_t intr = sample.system->get_intr_count();
+    uint64_t ctxt = sample.system->get_ctxt_count();
+
+    if (this->last_timestamp != 0 && sample.timestamp > this->last_timestamp)
+    {
+      float elapsed = (sample.timestamp - this->last_timestamp) / 1e9f;
+
+      this->table[static_cast<uint8_t>(Metric::IntrRate) * rows + this->cpu_cnt] =
+        (intr - this->last_intr) / elapsed;
+      this->table[static_cast<uint8_t>(Metric::CtxtRate) * rows + this->cpu_cnt] =
+        (ctxt - this->last_ctxt) / elapsed;
+    }
+
+    this->last_intr = intr;
+    this->last_ctxt = ctxt;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method writes an event line:
+  //  <unix time> <raised|cleared> <rule> <target> <metric>=<value>
+  //
+  //*****************************************************************************
+  void RuleEngine::emit(const Instruction &instruction, uint32_t offset, float value,
+                        bool raised, const Sample &sample)
+  {
+    if (!this->output)
+    {
+      return;
+    }
+
+    std::ostream &os = *this->output;
+
+    os << sample.wall_time / 1000000000 << "."
+       << std::setw(3) << std::setfill('0') << (sample.wall_time / 1000000) % 1000
+       << std::setfill(' ') << " ";
+    os << (raised ? "raised " : "cleared ") << this->names[instruction.rule_idx] << " ";
+
+    if (instruction.first_target < 0)
+    {
+      os << "system ";
+    }
+    else
+    {
+      os << "cpu" << (instruction.first_target + offset) << " ";
+    }
+
+    os << METRIC_NAMES[instruction.value_idx / (this->cpu_cnt + 1)] << "="
+       << std::setprecision(1) << std::fixed << value << "\n";
+  }
+}
@@ -0,0 +1,163 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     rules.h
+//
+//*****************************************************************************
+
+#ifndef __RULES_H__
+#define __RULES_H__
+
+namespace procstat
+{
+  //*****************************************************************************
+  //
+  //  Strong type enumeration for the metrics available to the rules. The
+  //  first ones are per CPU percentages since the previous sample, in the
+  //  same order as CpuField, and the last ones are system rates per second.
+  //
+  //*****************************************************************************
+  enum class Metric : uint8_t
+  {
+    User,
+    Nice,
+    System,
+    Idle,
+    Iowait,
+    Irq,
+    Softirq,
+    Steal,
+    Busy,
+    IntrRate,
+    CtxtRate,
+    Count
+  };
+
+  //*****************************************************************************
+  //
+  //  RuleEngine class.
+  //  This class loads threshold rules from a configuration file and compiles
+  //  them once into a flat program of instructions, one per rule, each one
+  //  covering a span of targets (e.g. "cpu*" covers every CPU). On every
+  //  sample the metrics are computed into a table and the program is run
+  //  over it, writing an event when a rule is raised or cleared.
+  //
+  //  Each configuration line holds a rule (fields in brackets are optional):
+  //
+  //    <name> <target> <metric> <op> <threshold> [for <sec>] [clear <value>]
+  //      [window <sec>]
+  //
+  //  target - "cpu*" for every CPU, "cpuN" for a single CPU, or "system".
+  //  metric - user, nice, system, idle, iowait, irq, softirq, steal, busy
+  //           (CPU targets), intr_rate, ctxt_rate (system target).
+  //  op - ">" or "<".
+  //  threshold - a number, or "<factor>xmean" to compare against the mean
+  //              of the metric over the last "window" seconds (default 60).
+  //  for - seconds the condition must hold before the rule is raised (0 or
+  //        more).
+  //  clear - value the metric must cross back to clear the rule
+  //          (hysteresis), by default the threshold itself. It cannot be
+  //          past the threshold (e.g. above it for a ">" rule).
+  //  window - seconds averaged by the mean (more than 0).
+  //
+  //  Empty lines and lines starting with '#' are ignored.
+  //
+  //*****************************************************************************
+  class RuleEngine
+  {
+    public:
+      //
+      //  Constructor.
+      //
+      RuleEngine();
+
+      //
+      //  Load and compile the rules file for a number of CPUs. Returns false
+      //  on error, with a description available through get_error.
+      //
+      bool load(const std::string &path, uint32_t cpu_cnt);
+      const std::string &get_error(void) const;
+
+      //
+      //  Getter methods for the number of rules and of targets they were
+      //  expanded to (e.g. a "cpu*" rule has one target per CPU).
+      //
+      uint32_t get_rule_count(void) const;
+      uint32_t get_target_count(void) const;
+
+      //
+      //  Setter method for the stream where the events are written.
+      //
+      void set_output(std::ostream* os);
+
+      //
+      //  Evaluate the rules on a sample. The static version can be given
+      //  to Sampler::subscribe with the engine as context.
+      //
+      void evaluate(const Sample &sample);
+      static void on_sample(const Sample &sample, void* context);
+    private:
+      //
+      //  Compiled rule. It covers a contiguous span of targets in the
+      //  metrics table, which is stored by metric so that the values of
+      //  all the CPUs for a metric are next to each other. The thresholds
+      //  are abs + rel * mean, and the values are multiplied by sign so
+      //  that "<" rules are evaluated as ">" rules.
+      //
+      struct Instruction
+      {
+        uint32_t value_idx;
+        uint32_t state_idx;
+        uint32_t count;
+        uint32_t rule_idx;
+        int32_t first_target;
+        float sign;
+        float raise_abs;
+        float raise_rel;
+        float clear_abs;
+        float clear_rel;
+        float inv_window;
+        float duration;
+      };
+
+      static const uint32_t COLUMNS = static_cast<uint8_t>(Metric::Count);
+
+      //
+      //  Number of targets evaluated together by the vectorized loops.
+      //
+      static const uint32_t BLOCK = 64;
+
+      uint32_t cpu_cnt;
+      std::string error;
+      std::ostream* output;
+      std::vector<std::string> names;
+      std::vector<Instruction> program;
+      std::vector<float> table;
+      std::vector<float> held;
+      std::vector<float> means;
+      std::vector<uint32_t> active;
+      std::vector<uint32_t> online;
+      uint32_t state_cnt;
+      uint32_t target_cnt;
+      bool seeded;
+      uint64_t last_timestamp;
+      uint64_t last_intr;
+      uint64_t last_ctxt;
+
+      bool compile_line(const std::string &line, uint32_t line_num);
+      void compute_table(const Sample &sample);
+      static bool find_changes(const Instruction &instruction, const float* __restrict values,
+                               const float* __restrict bases, const uint32_t* __restrict online,
+                               uint32_t count, const uint32_t* __restrict active,
+                               uint32_t* __restrict flags);
+      static void reset_held(const uint32_t* __restrict online, const uint32_t* __restrict flags,
+                             float* __restrict held);
+      static void update_means(const float* __restrict values, const uint32_t* __restrict online,
+                               float alpha, float* __restrict means);
+      void emit(const Instruction &instruction, uint32_t offset, float value,
+                bool raised, const Sample &sample);
+  };
+}
+
+#endif  // __RULES_H__
@@ -0,0 +1,684 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     sampler.cpp
+//
+//*****************************************************************************
+//
+//  Standard string class.
+//
+#include <string>
+//
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Atomic operations library.
+//
+#include <atomic>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//  C string handling functions.
+//
+#include <cstring>
+//
+//  C error numbers.
+//
+#include <cerrno>
+//
+//  POSIX file control, read and close.
+//
+#include <fcntl.h>
+#include <unistd.h>
+//
+//  Linux timer file descriptors and POSIX clocks.
+//
+#include <sys/timerfd.h>
+#include <time.h>
+//
+//
+//
+#include "cpu.h"
+#include "system.h"
+#include "parser.h"
+#include "chunk_parser.h"
+#include "sampler.h"
+#include "profiler.h"
+
+namespace procstat
+{
+  //
+  //  Initial size of the file buffer. It grows by doubling
+  //  when a snapshot does not fit in it.
+  //
+  static const size_t BUFFER_SIZE = 4096;
+
+  //*****************************************************************************
+  //
+  //  Constructor: Initialize the file descriptors as closed and the CPUs
+  //  array as empty. The resources are acquired by the open method.
+  //
+  //*****************************************************************************
+  Sampler::Sampler(uint32_t interval_ms)
+    : file_fd(-1), timer_fd(-1), interval_ms(interval_ms),
+      base_interval_ms(interval_ms), interval_floor_ms(0), cpu_cnt(0),
+      sequence(0), cpu(nullptr), buffer(BUFFER_SIZE, '\0'), adaptive(false),
+      config(), fingerprint(0), skipped(0), last_intr(0), last_timestamp(0)
+  {
+
+  }
+
+  //*****************************************************************************
+  //
+  //  Destructor: Close the file descriptors and free the CPUs array.
+  //
+  //*****************************************************************************
+  Sampler::~Sampler()
+  {
+    if (this->file_fd >= 0)
+    {
+      close(this->file_fd);
+    }
+
+    if (this->timer_fd >= 0)
+    {
+      close(this->timer_fd);
+    }
+
+    delete [] this->cpu;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method opens the "/proc/stat" file, counts the number of CPUs
+  //  listed in it, allocates the Cpu objects array and arms the timer.
+  //
+  //*****************************************************************************
+  bool Sampler::open(void)
+  {
+    this->file_fd = ::open("/proc/stat", O_RDONLY | O_CLOEXEC);
+
+    if (this->file_fd < 0 || !read_file())
+    {
+      return false;
+    }
+
+    //
+    //  Find the highest CPU index, ignoring the first line
+    //  which holds the aggregate of all CPUs. Offline CPUs
+    //  are not listed, so the CPU lines are stored by index
+    //  rather than by position.
+    //
+    size_t start = this->buffer.find('\n');
+
+    while (start != std::string::npos && ++start < this->buffer.length())
+    {
+      size_t end = this->buffer.find('\n', start);
+      end = (end == std::string::npos) ? this->buffer.length() : end;
+
+      this->parser.parse_line(&this->buffer[start], &this->buffer[0] + end);
+
+      if (this->parser.get_label() == Label::Cpu && this->parser.get_cpu_index() >= 0 &&
+          static_cast<uint32_t>(this->parser.get_cpu_index()) >= this->cpu_cnt)
+      {
+        this->cpu_cnt = this->parser.get_cpu_index() + 1;
+      }
+      start = end;
+    }
+
+    this->cpu = new Cpu[this->cpu_cnt];
+
+    this->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (this->timer_fd < 0)
+    {
+      return false;
+    }
+
+    arm_timer();
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the timer file descriptor to be watched for
+  //  readability by the event loop.
+  //
+  //*****************************************************************************
+  int Sampler::get_fd(void) const
+  {
+    return this->timer_fd;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the number of CPUs found in the file.
+  //
+  //*****************************************************************************
+  uint32_t Sampler::get_cpu_count(void) const
+  {
+    return this->cpu_cnt;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the current sampling period, which changes over
+  //  time in adaptive mode and when a floor is set.
+  //
+  //*****************************************************************************
+  uint32_t Sampler::get_interval(void) const
+  {
+    return this->interval_ms;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the number of reads skipped because the fingerprint
+  //  did not change.
+  //
+  //*****************************************************************************
+  uint64_t Sampler::get_skipped_count(void) const
+  {
+    return this->skipped;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method changes the sampling period. The timer runs at the longest
+  //  of this period and the floor, and if it is already running it is
+  //  re-armed when that changes.
+  //
+  //*****************************************************************************
+  void Sampler::set_interval(uint32_t interval_ms)
+  {
+    this->base_interval_ms = interval_ms;
+
+    if (interval_ms < this->interval_floor_ms)
+    {
+      interval_ms = this->interval_floor_ms;
+    }
+
+    if (interval_ms != this->interval_ms)
+    {
+      this->interval_ms = interval_ms;
+
+      if (this->timer_fd >= 0)
+      {
+        arm_timer();
+      }
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This method changes the floor of the sampling period. The period set
+  //  before is kept, so it comes back when the floor is lowered.
+  //
+  //*****************************************************************************
+  void Sampler::set_interval_floor(uint32_t floor_ms)
+  {
+    this->interval_floor_ms = floor_ms;
+
+    set_interval(this->base_interval_ms);
+  }
+
+  //*****************************************************************************
+  //
+  //  This method enables the adaptive mode. The current period is brought
+  //  within the configured bounds.
+  //
+  //*****************************************************************************
+  void Sampler::set_adaptive(const AdaptiveConfig &config)
+  {
+    uint32_t interval_ms = this->base_interval_ms;
+
+    this->adaptive = true;
+    this->config = config;
+
+    interval_ms = (interval_ms < config.min_interval_ms) ? config.min_interval_ms : interval_ms;
+    interval_ms = (interval_ms > config.max_interval_ms) ? config.max_interval_ms : interval_ms;
+
+    if (interval_ms != this->base_interval_ms)
+    {
+      set_interval(interval_ms);
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This method changes the maximum number of threads used to parse
+  //  large snapshots.
+  //
+  //*****************************************************************************
+  void Sampler::set_parse_threads(uint32_t thread_cnt)
+  {
+    this->chunk_parser.set_thread_count(thread_cnt);
+  }
+
+  //*****************************************************************************
+  //
+  //  This method registers a callback to be invoked on every sample.
+  //
+  //*****************************************************************************
+  void Sampler::subscribe(SampleCallback callback, void* context)
+  {
+    this->subscribers.push_back({callback, context});
+  }
+
+  //*****************************************************************************
+  //
+  //  This method registers a callback to be invoked on the next sample only.
+  //
+  //*****************************************************************************
+  void Sampler::subscribe_once(SampleCallback callback, void* context)
+  {
+    this->waiters.push_back({callback, context});
+  }
+
+  //*****************************************************************************
+  //
+  //  This method must be called when the timer file descriptor is readable.
+  //  It consumes the timer expirations and takes a new sample. Spurious
+  //  wake-ups (no expirations pending) are ignored.
+  //
+  //*****************************************************************************
+  bool Sampler::handle_event(void)
+  {
+    uint64_t expirations = 0;
+
+    if (read(this->timer_fd, &expirations, sizeof(expirations)) < 0)
+    {
+      return (errno == EAGAIN);
+    }
+
+    return sample();
+  }
+
+  //*****************************************************************************
+  //
+  //  This method reads the file, parses the lines, stores the data on the
+  //  corresponding object and notifies the subscribers. In adaptive mode,
+  //  if the fingerprint of the file did not change since the previous read,
+  //  nothing is parsed nor notified and the period is lengthened.
+  //
+  //*****************************************************************************
+  bool Sampler::sample(void)
+  {
+    struct timespec now;
+    struct timespec wall;
+    uint32_t cpu_idx = 0;
+    uint64_t start = PROCSTAT_TICKS();
+
+    if (!read_file())
+    {
+      return false;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    clock_gettime(CLOCK_REALTIME, &wall);
+
+    bool unchanged = false;
+
+    if (this->adaptive)
+    {
+      uint64_t fingerprint = compute_fingerprint();
+
+      unchanged = (fingerprint == this->fingerprint && this->sequence > 0);
+      this->fingerprint = fingerprint;
+    }
+
+    //
+    //  The reads skipped below are recorded too,
+    //  so the read stage counts every timer tick.
+    //
+    uint64_t parsed = PROCSTAT_TICKS();
+    PROCSTAT_RECORD(Stage::Read, start, parsed);
+
+    if (unchanged)
+    {
+      this->skipped++;
+
+      if (this->base_interval_ms < this->config.max_interval_ms)
+      {
+        uint32_t interval_ms = this->base_interval_ms * 2;
+        set_interval((interval_ms > this->config.max_interval_ms) ?
+                     this->config.max_interval_ms : interval_ms);
+      }
+
+      return true;
+    }
+
+    //
+    //  CPUs missing from the snapshot (offline) are
+    //  left with an empty interval, not their last one.
+    //
+    for (uint32_t i = 0; i < this->cpu_cnt; i++)
+    {
+      this->cpu[i].clear_interval();
+    }
+
+    size_t begin = this->buffer.find('\n');
+    bool chunked = (begin != std::string::npos &&
+                    this->chunk_parser.get_chunk_count(this->buffer.length() - begin) > 1);
+
+    //
+    //  Large snapshots are handed to the chunk parser, which
+    //  parses the lines and updates the objects at once.
+    //
+    if (chunked)
+    {
+      begin++;
+      this->chunk_parser.parse(&this->buffer[begin], this->buffer.length() - begin,
+                               this->cpu, this->cpu_cnt, this->system);
+      begin = std::string::npos;
+    }
+
+    //
+    //  Loop through the lines, ignoring the first one. The
+    //  lines are parsed in place in the buffer, without copies.
+    //
+    while (begin != std::string::npos && ++begin < this->buffer.length())
+    {
+      size_t end = this->buffer.find('\n', begin);
+
+      if (end == std::string::npos)
+      {
+        end = this->buffer.length();
+      }
+
+      this->parser.parse_line(&this->buffer[begin], &this->buffer[0] + end);
+      uint64_t* data = this->parser.get_data();
+
+      //
+      //  Set the data into the corresponding object.
+      //
+      switch (this->parser.get_label())
+      {
+        case Label::Cpu:
+          cpu_idx = static_cast<uint32_t>(this->parser.get_cpu_index());
+
+          if (cpu_idx < this->cpu_cnt)
+          {
+            this->cpu[cpu_idx].set_data(data);
+          }
+          break;
+
+        case Label::Page:
+          this->system.set_page_data(data);
+          break;
+
+        case Label::Swap:
+          this->system.set_swap_data(data);
+          break;
+
+        case Label::Intr:
+          this->system.set_intr_data(data);
+          break;
+
+        case Label::Ctxt:
+          this->system.set_ctxt_data(data);
+          break;
+
+        case Label::Btime:
+          this->system.set_btime_data(data);
+          break;
+
+        default:
+          break;
+      }
+
+      begin = end;
+    }
+
+    //
+    //  Reading the clock per line would cost as much as
+    //  parsing short lines, so the parse of the lines and
+    //  the update of the objects are timed as a whole.
+    //
+    uint64_t updated = PROCSTAT_TICKS();
+    PROCSTAT_RECORD(Stage::Parse, parsed, updated);
+
+    uint64_t timestamp = static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+
+    if (this->adaptive)
+    {
+      adapt(timestamp);
+    }
+
+    //
+    //  Notify the subscribers. All of them
+    //  receive a view of the same data.
+    //
+    Sample sample;
+    sample.cpu = this->cpu;
+    sample.cpu_cnt = this->cpu_cnt;
+    sample.system = &this->system;
+    sample.timestamp = timestamp;
+    sample.wall_time = static_cast<uint64_t>(wall.tv_sec) * 1000000000 + wall.tv_nsec;
+    sample.sequence = this->sequence++;
+    sample.data = this->buffer.data();
+    sample.length = this->buffer.length();
+
+    //
+    //  The subscribers are walked by index up to the count
+    //  before the loop, so a callback may subscribe another
+    //  one (from the next sample on) without invalidating it.
+    //
+    size_t subscriber_cnt = this->subscribers.size();
+
+    for (size_t i = 0; i < subscriber_cnt; i++)
+    {
+      Subscriber subscriber = this->subscribers[i];
+      subscriber.callback(sample, subscriber.context);
+    }
+
+    //
+    //  The one-shot callbacks are moved out before being
+    //  invoked, so they can subscribe again for the next
+    //  sample (e.g. a coroutine awaiting in a loop).
+    //
+    if (!this->waiters.empty())
+    {
+      this->woken.swap(this->waiters);
+
+      for (const Subscriber &waiter : this->woken)
+      {
+        waiter.callback(sample, waiter.context);
+      }
+
+      this->woken.clear();
+    }
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method reads the whole file into the buffer from the
+  //  start. If the file does not fit, the buffer is doubled and the file
+  //  read again, so after a few samples no more allocations are done.
+  //
+  //*****************************************************************************
+  bool Sampler::read_file(void)
+  {
+    while (1)
+    {
+      this->buffer.resize(this->buffer.capacity());
+
+      ssize_t length = pread(this->file_fd, &this->buffer[0], this->buffer.length(), 0);
+
+      if (length < 0)
+      {
+        return false;
+      }
+
+      if (static_cast<size_t>(length) < this->buffer.length())
+      {
+        this->buffer.resize(length);
+        return true;
+      }
+
+      this->buffer.resize(this->buffer.length() * 2);
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method arms the timer with the sampling period. The first
+  //  expiration happens after one period.
+  //
+  //*****************************************************************************
+  void Sampler::arm_timer(void)
+  {
+    struct itimerspec spec;
+
+    spec.it_interval.tv_sec = this->interval_ms / 1000;
+    spec.it_interval.tv_nsec = (this->interval_ms % 1000) * 1000000L;
+    spec.it_value = spec.it_interval;
+
+    timerfd_settime(this->timer_fd, 0, &spec, nullptr);
+  }
+
+  //*****************************************************************************
+  //
+  //  This function mixes a block of bytes into a hash, eight bytes at a
+  //  time. It does not need to be a strong hash, only to change when any
+  //  byte changes.
+  //
+  //*****************************************************************************
+  static uint64_t hash_bytes(uint64_t hash, const char* data, size_t length)
+  {
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ULL;
+    uint64_t word;
+
+    while (length >= 8)
+    {
+      memcpy(&word, data, 8);
+      hash = (hash ^ word) * multiplier;
+      hash ^= hash >> 32;
+      data += 8;
+      length -= 8;
+    }
+
+    word = 0;
+    memcpy(&word, data, length);
+    hash = (hash ^ word ^ length) * multiplier;
+
+    return hash ^ (hash >> 32);
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method computes the fingerprint of the CPU lines in the
+  //  buffer. In Busy mode the idle field (4th value) is left out of it.
+  //
+  //*****************************************************************************
+  uint64_t Sampler::compute_fingerprint(void) const
+  {
+    const char* data = this->buffer.data();
+    const char* end = data + this->buffer.length();
+    const char* pos = data;
+    uint64_t hash = 0;
+
+    //
+    //  Find the end of the CPU lines, which come always first.
+    //
+    while (pos < end && (end - pos) > 3 && memcmp(pos, "cpu", 3) == 0)
+    {
+      const char* line_end = static_cast<const char*>(memchr(pos, '\n', end - pos));
+      line_end = line_end ? line_end : end;
+
+      if (this->config.fingerprint == Fingerprint::Busy)
+      {
+        const char* field = pos;
+        uint8_t field_idx = 0;
+
+        //
+        //  Hash the label and every value but idle (4). Iowait
+        //  moves only when tasks wait on I/O, which is activity.
+        //
+        while (field < line_end)
+        {
+          const char* field_end = static_cast<const char*>(memchr(field, ' ', line_end - field));
+          field_end = field_end ? field_end : line_end;
+
+          //
+          //  Empty fields (e.g. the double space after
+          //  the aggregate "cpu" label) are not counted.
+          //
+          if (field_end > field)
+          {
+            if (field_idx != 4)
+            {
+              hash = hash_bytes(hash, field, field_end - field);
+            }
+            field_idx++;
+          }
+
+          field = field_end + 1;
+        }
+      }
+
+      pos = line_end + 1;
+    }
+
+    if (this->config.fingerprint == Fingerprint::Cpu)
+    {
+      hash = hash_bytes(hash, data, ((pos < end) ? pos : end) - data);
+    }
+
+    return hash;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method adapts the sampling period to the activity since
+  //  the previous sample: it drops to the minimum when the busiest CPU or
+  //  the interrupts rate are high, so a burst is seen in detail right away,
+  //  and it is doubled when both are low.
+  //
+  //*****************************************************************************
+  void Sampler::adapt(uint64_t timestamp)
+  {
+    uint64_t intr = this->system.get_intr_count();
+    float busy = 0;
+    float intr_rate = 0;
+    uint32_t interval_ms = this->base_interval_ms;
+
+    for (uint32_t i = 0; i < this->cpu_cnt; i++)
+    {
+      float cpu_busy = this->cpu[i].get_interval_busy_pct();
+      busy = (cpu_busy > busy) ? cpu_busy : busy;
+    }
+
+    if (this->last_timestamp != 0 && timestamp > this->last_timestamp)
+    {
+      intr_rate = (intr - this->last_intr) / ((timestamp - this->last_timestamp) / 1e9f);
+    }
+
+    this->last_intr = intr;
+    this->last_timestamp = timestamp;
+
+    if (busy >= this->config.busy_high || intr_rate >= this->config.intr_rate_high)
+    {
+      interval_ms = this->config.min_interval_ms;
+    }
+    else if (busy < this->config.busy_low && intr_rate < this->config.intr_rate_low)
+    {
+      interval_ms *= 2;
+    }
+
+    interval_ms = (interval_ms < this->config.min_interval_ms) ? this->config.min_interval_ms : interval_ms;
+    interval_ms = (interval_ms > this->config.max_interval_ms) ? this->config.max_interval_ms : interval_ms;
+
+    if (interval_ms != this->base_interval_ms)
+    {
+      set_interval(interval_ms);
+    }
+  }
+}
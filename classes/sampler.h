@@ -0,0 +1,261 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     sampler.h
+//
+//*****************************************************************************
+
+#ifndef __SAMPLER_H__
+#define __SAMPLER_H__
+
+//
+//  Coroutine support library, for the awaitable of C++20 builds.
+//
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#endif
+
+namespace procstat
+{
+  //*****************************************************************************
+  //
+  //  Sample structure.
+  //  Read-only view of the last "/proc/stat" snapshot. The Cpu and System
+  //  objects are owned by the Sampler, so every subscriber shares the same
+  //  data without copies. The view is valid until the next sample is taken.
+  //  CPUs missing from the snapshot (offline) have an empty interval and
+  //  Cpu::is_online returns false for them.
+  //  timestamp - CLOCK_MONOTONIC time of the sample in nanoseconds.
+  //  wall_time - CLOCK_REALTIME time of the sample in nanoseconds.
+  //  sequence - number of samples taken before this one.
+  //  data, length - raw contents of the file the sample was parsed from.
+  //
+  //*****************************************************************************
+  struct Sample
+  {
+    const Cpu* cpu;
+    uint32_t cpu_cnt;
+    const System* system;
+    uint64_t timestamp;
+    uint64_t wall_time;
+    uint64_t sequence;
+    const char* data;
+    size_t length;
+  };
+
+  //
+  //  Subscriber callback, invoked once per sample with the user context
+  //  given at subscription time.
+  //
+  typedef void (*SampleCallback)(const Sample &sample, void* context);
+
+  //*****************************************************************************
+  //
+  //  Strong type enumeration for the bytes of the file used to detect that
+  //  nothing changed between two reads.
+  //  Cpu - the CPU lines.
+  //  Busy - every counter of the CPU lines but idle, so hosts that are
+  //         only idling are seen as unchanged.
+  //
+  //*****************************************************************************
+  enum class Fingerprint : uint8_t
+  {
+    Cpu,
+    Busy
+  };
+
+  //*****************************************************************************
+  //
+  //  Adaptive sampling configuration.
+  //  min_interval_ms, max_interval_ms - bounds of the sampling period.
+  //  busy_high, busy_low - busiest CPU percentage above which the period
+  //                        drops to the minimum, and below which it can be
+  //                        doubled.
+  //  intr_rate_high, intr_rate_low - same as above for the interrupts per
+  //                                  second. Both the busy and interrupts
+  //                                  must be low to double the period.
+  //  fingerprint - bytes compared to skip unchanged reads.
+  //
+  //*****************************************************************************
+  struct AdaptiveConfig
+  {
+    uint32_t min_interval_ms;
+    uint32_t max_interval_ms;
+    float busy_high;
+    float busy_low;
+    float intr_rate_high;
+    float intr_rate_low;
+    Fingerprint fingerprint;
+  };
+
+  //*****************************************************************************
+  //
+  //  Sampler class.
+  //  This class samples the "/proc/stat" file without blocking the caller.
+  //  The sampling period is driven by a timer file descriptor, which can be
+  //  registered in any epoll/poll/select based event loop. When the descriptor
+  //  becomes readable, handle_event must be called to take the sample and
+  //  notify the subscribers. In C++20 builds, coroutines can also wait for
+  //  the next sample with "co_await sampler.next()".
+  //
+  //  In adaptive mode, a fingerprint of the file is compared with the one of
+  //  the previous read, and if nothing changed the parse and the subscribers
+  //  are skipped. The period is shortened when the host is busy and
+  //  lengthened when it is quiet, within the configured bounds.
+  //
+  //  Snapshots larger than the chunk size of the ChunkParser (hosts with
+  //  thousands of CPUs) are parsed in parallel on several threads.
+  //
+  //*****************************************************************************
+  class Sampler
+  {
+    public:
+      //
+      //  Constructor and destructor.
+      //
+      Sampler(uint32_t interval_ms);
+      ~Sampler();
+
+      //
+      //  The Sampler owns file descriptors and the Cpu objects array,
+      //  so it cannot be copied.
+      //
+      Sampler(const Sampler &) = delete;
+      Sampler &operator=(const Sampler &) = delete;
+
+      //
+      //  Open the file, discover the number of CPUs and arm the timer.
+      //  Returns false if the file or the timer cannot be created.
+      //
+      bool open(void);
+
+      //
+      //  Getter methods for the timer file descriptor, number of CPUs,
+      //  current sampling period and number of reads skipped because
+      //  nothing changed.
+      //
+      int get_fd(void) const;
+      uint32_t get_cpu_count(void) const;
+      uint32_t get_interval(void) const;
+      uint64_t get_skipped_count(void) const;
+
+      //
+      //  Setter methods for the sampling period and adaptive mode.
+      //
+      void set_interval(uint32_t interval_ms);
+      void set_adaptive(const AdaptiveConfig &config);
+
+      //
+      //  Setter method for a floor on the sampling period (0 for none),
+      //  applied over the period set by the user or the adaptive mode.
+      //  It is used to keep the cost of the monitor within a budget.
+      //
+      void set_interval_floor(uint32_t floor_ms);
+
+      //
+      //  Setter method for the maximum number of threads used to parse
+      //  large snapshots (0 for the number of CPUs the calling thread may
+      //  run on, 1 to always parse on the calling thread).
+      //
+      void set_parse_threads(uint32_t thread_cnt);
+
+      //
+      //  Subscription methods for the sample callbacks: on every sample,
+      //  or on the next one only (the callback may subscribe again).
+      //
+      void subscribe(SampleCallback callback, void* context);
+      void subscribe_once(SampleCallback callback, void* context);
+
+#ifdef __cpp_impl_coroutine
+      //
+      //  Awaitable returned by next. The coroutine is resumed from
+      //  handle_event with a copy of the view of the next sample, after
+      //  the subscribers. It must not be destroyed while it waits.
+      //
+      class NextSample
+      {
+        public:
+          explicit NextSample(Sampler &sampler) : sampler(sampler), sample() {}
+
+          bool await_ready(void) const noexcept
+          {
+            return false;
+          }
+
+          void await_suspend(std::coroutine_handle<> handle)
+          {
+            this->handle = handle;
+            this->sampler.subscribe_once(&NextSample::on_sample, this);
+          }
+
+          Sample await_resume(void) const noexcept
+          {
+            return this->sample;
+          }
+        private:
+          Sampler &sampler;
+          std::coroutine_handle<> handle;
+          Sample sample;
+
+          static void on_sample(const Sample &sample, void* context)
+          {
+            NextSample* next = static_cast<NextSample*>(context);
+            next->sample = sample;
+            next->handle.resume();
+          }
+      };
+
+      //
+      //  Wait for the next sample from a coroutine, e.g.
+      //  "Sample sample = co_await sampler.next();".
+      //
+      NextSample next(void)
+      {
+        return NextSample(*this);
+      }
+#endif
+
+      //
+      //  Event handler for the timer file descriptor, and method to take
+      //  a sample right away. Both return false on a read error.
+      //
+      bool handle_event(void);
+      bool sample(void);
+    private:
+      struct Subscriber
+      {
+        SampleCallback callback;
+        void* context;
+      };
+
+      int file_fd;
+      int timer_fd;
+      uint32_t interval_ms;
+      uint32_t base_interval_ms;
+      uint32_t interval_floor_ms;
+      uint32_t cpu_cnt;
+      uint64_t sequence;
+      Cpu* cpu;
+      System system;
+      Parser parser;
+      ChunkParser chunk_parser;
+      std::string buffer;
+      std::vector<Subscriber> subscribers;
+      std::vector<Subscriber> waiters;
+      std::vector<Subscriber> woken;
+      bool adaptive;
+      AdaptiveConfig config;
+      uint64_t fingerprint;
+      uint64_t skipped;
+      uint64_t last_intr;
+      uint64_t last_timestamp;
+
+      bool read_file(void);
+      void arm_timer(void);
+      uint64_t compute_fingerprint(void) const;
+      void adapt(uint64_t timestamp);
+  };
+}
+
+#endif  // __SAMPLER_H__
@@ -0,0 +1,126 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     sketch.cpp
+//
+//*****************************************************************************
+//
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//
+//
+#include "log_linear.h"
+#include "sketch.h"
+
+namespace procstat
+{
+  //*****************************************************************************
+  //
+  //  Constructor: Allocate the buckets up to the largest value accepted.
+  //
+  //*****************************************************************************
+  Sketch::Sketch(uint8_t value_bits)
+    : count(0)
+  {
+    value_bits = (value_bits < SUB_BITS) ? SUB_BITS : ((value_bits > 63) ? 63 : value_bits);
+
+    this->max_value = (1ULL << value_bits) - 1;
+    this->counts.assign(LogLinear<SUB_BITS>::get_bucket(this->max_value) + 1, 0);
+  }
+
+  //*****************************************************************************
+  //
+  //  This method records a value, clamped to the largest value accepted.
+  //
+  //*****************************************************************************
+  void Sketch::add(uint64_t value)
+  {
+    value = (value > this->max_value) ? this->max_value : value;
+
+    this->counts[LogLinear<SUB_BITS>::get_bucket(value)]++;
+    this->count++;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method adds the counts of another sketch. Sketches of different
+  //  sizes are not merged.
+  //
+  //*****************************************************************************
+  void Sketch::merge(const Sketch &other)
+  {
+    if (other.counts.size() != this->counts.size())
+    {
+      return;
+    }
+
+    for (uint32_t i = 0; i < this->counts.size(); i++)
+    {
+      this->counts[i] += other.counts[i];
+    }
+
+    this->count += other.count;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the number of values recorded.
+  //
+  //*****************************************************************************
+  uint64_t Sketch::get_count(void) const
+  {
+    return this->count;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the middle of the bucket holding a percentile,
+  //  which halves the error compared with the lowest value of the bucket.
+  //
+  //*****************************************************************************
+  uint64_t Sketch::get_percentile(float percentile) const
+  {
+    if (this->count == 0)
+    {
+      return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(this->count * (percentile / 100));
+    uint64_t seen = 0;
+
+    target = (target >= this->count) ? (this->count - 1) : target;
+
+    for (uint32_t i = 0; i < this->counts.size(); i++)
+    {
+      seen += this->counts[i];
+
+      if (seen > target)
+      {
+        uint64_t low = LogLinear<SUB_BITS>::get_bucket_value(i);
+        uint64_t high = LogLinear<SUB_BITS>::get_bucket_value(i + 1) - 1;
+
+        return low + (high - low) / 2;
+      }
+    }
+
+    return this->max_value;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method removes all the values.
+  //
+  //*****************************************************************************
+  void Sketch::clear(void)
+  {
+    this->counts.assign(this->counts.size(), 0);
+    this->count = 0;
+  }
+}
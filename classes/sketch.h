@@ -0,0 +1,65 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     sketch.h
+//
+//*****************************************************************************
+
+#ifndef __SKETCH_H__
+#define __SKETCH_H__
+
+namespace procstat
+{
+  //*****************************************************************************
+  //
+  //  Sketch class.
+  //  This class keeps an approximate distribution of unsigned values in
+  //  log-linear buckets (see LogLinear), like the Histogram class, with 32
+  //  buckets per power of two. The percentiles are within 1.6% of the exact
+  //  value, and the size only depends on the largest value accepted, not on
+  //  the number of values recorded. The counts are 64-bit, so they do not
+  //  wrap however many values are recorded or merged. Two sketches of the same size are merged by adding
+  //  their counts, so partial distributions can be built apart and combined.
+  //
+  //*****************************************************************************
+  class Sketch
+  {
+    public:
+      //
+      //  Constructor. Values are accepted up to 2^value_bits - 1, and
+      //  larger ones are recorded as the largest.
+      //
+      Sketch(uint8_t value_bits = 32);
+
+      //
+      //  Record a value.
+      //
+      void add(uint64_t value);
+
+      //
+      //  Add the counts of another sketch with the same value bits.
+      //
+      void merge(const Sketch &other);
+
+      //
+      //  Getter methods for the number of values recorded and the
+      //  approximate value of a percentile (0 to 100).
+      //
+      uint64_t get_count(void) const;
+      uint64_t get_percentile(float percentile) const;
+
+      //
+      //  Remove all the values.
+      //
+      void clear(void);
+    private:
+      static const uint32_t SUB_BITS = 5;
+
+      uint64_t max_value;
+      uint64_t count;
+      std::vector<uint64_t> counts;
+  };
+}
+
+#endif  // __SKETCH_H__
@@ -0,0 +1,922 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     store.cpp
+//
+//*****************************************************************************
+//
+//  Standard string class.
+//
+#include <string>
+//
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Standard algorithms (binary searches).
+//
+#include <algorithm>
+//
+//  C string handling functions.
+//
+#include <cstring>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//  C error numbers.
+//
+#include <cerrno>
+//
+//  POSIX file control, read, write and memory mapping.
+//
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+//
+//
+//
+#include "cpu.h"
+#include "system.h"
+#include "parser.h"
+#include "chunk_parser.h"
+#include "sampler.h"
+#include "store.h"
+
+namespace procstat
+{
+  //
+  //  Layout constants: the file header takes the first page,
+  //  and the blocks and their headers are page aligned.
+  //
+  static const size_t PAGE_SIZE = 4096;
+  static const size_t FILE_HEADER_SIZE = PAGE_SIZE;
+  static const uint32_t STORE_VERSION = 2;
+  static const char STORE_MAGIC[8] = {'P', 'S', 'T', 'S', 'T', 'O', 'R', 'E'};
+
+  //
+  //  Maximum time in milliseconds the block being
+  //  filled is held in memory before being written.
+  //
+  static const uint64_t FLUSH_PERIOD = 60000;
+
+  //*****************************************************************************
+  //
+  //  These functions return the offsets, from the start of a block, of the
+  //  CPU sums, counts, minimums and maximums, the sample times and the
+  //  values of a CPU.
+  //
+  //*****************************************************************************
+  static size_t get_sums_offset(const StoreHeader &)
+  {
+    return sizeof(BlockHeader);
+  }
+
+  static size_t get_counts_offset(const StoreHeader &header)
+  {
+    return sizeof(BlockHeader) + header.cpu_cnt * sizeof(uint64_t);
+  }
+
+  static size_t get_mins_offset(const StoreHeader &header)
+  {
+    return get_counts_offset(header) + header.cpu_cnt * sizeof(uint32_t);
+  }
+
+  static size_t get_maxs_offset(const StoreHeader &header)
+  {
+    return get_mins_offset(header) + header.cpu_cnt * sizeof(uint16_t);
+  }
+
+  static size_t get_times_offset(const StoreHeader &header)
+  {
+    return header.header_size;
+  }
+
+  static size_t get_values_offset(const StoreHeader &header, uint32_t cpu)
+  {
+    return header.header_size + header.block_samples * sizeof(uint64_t) +
+           static_cast<size_t>(cpu) * header.block_samples * sizeof(uint16_t);
+  }
+
+  //*****************************************************************************
+  //
+  //  This function returns the number of samples of a block, which cannot
+  //  be more than the samples a block holds even if its header is damaged.
+  //
+  //*****************************************************************************
+  static uint32_t get_sample_count(const StoreHeader &header, const BlockHeader &block_header)
+  {
+    return (block_header.sample_cnt < header.block_samples) ? block_header.sample_cnt : header.block_samples;
+  }
+
+  //*****************************************************************************
+  //
+  //  This function checks the file header of a store: the magic, the version
+  //  and that the block header holds the summaries of every CPU and the block
+  //  every sample, so no offset computed from it falls out of a block.
+  //
+  //*****************************************************************************
+  static bool is_valid_header(const StoreHeader &header)
+  {
+    uint64_t summaries_size = sizeof(BlockHeader) +
+                              static_cast<uint64_t>(header.cpu_cnt) *
+                              (sizeof(uint64_t) + sizeof(uint32_t) + 2 * sizeof(uint16_t));
+    uint64_t sample_size = sizeof(uint64_t) + static_cast<uint64_t>(header.cpu_cnt) * sizeof(uint16_t);
+
+    if (memcmp(header.magic, STORE_MAGIC, sizeof(STORE_MAGIC)) != 0 ||
+        header.version != STORE_VERSION || header.block_samples == 0 ||
+        header.header_size < summaries_size || header.block_size < header.header_size)
+    {
+      return false;
+    }
+
+    //
+    //  Divided rather than multiplied, as the
+    //  product can overflow on a damaged header.
+    //
+    return (header.block_size - header.header_size) / sample_size >= header.block_samples;
+  }
+
+  //*****************************************************************************
+  //
+  //  This function rounds a size up to a whole number of pages.
+  //
+  //*****************************************************************************
+  static size_t round_to_pages(size_t size)
+  {
+    return (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+  }
+
+  //*****************************************************************************
+  //
+  //  This function writes a whole range at a file offset, retrying on
+  //  partial writes and interruptions.
+  //
+  //*****************************************************************************
+  static bool write_at(int fd, const void* data, size_t length, off_t offset)
+  {
+    const char* pos = static_cast<const char*>(data);
+
+    while (length > 0)
+    {
+      ssize_t written = pwrite(fd, pos, length, offset);
+
+      if (written < 0 && errno != EINTR)
+      {
+        return false;
+      }
+      else if (written > 0)
+      {
+        pos += written;
+        length -= written;
+        offset += written;
+      }
+    }
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  Constructor: Initialize the layout of new stores. Existing stores keep
+  //  the layout they were created with.
+  //
+  //*****************************************************************************
+  StoreWriter::StoreWriter(uint32_t block_samples)
+    : fd(-1), index_fd(-1), header(), block_idx(0), last_ms(0), flush_time(0),
+      failed(false)
+  {
+    this->header.block_samples = (block_samples == 0) ? 1 : block_samples;
+  }
+
+  //*****************************************************************************
+  //
+  //  Destructor: Write the block being filled and close the files.
+  //
+  //*****************************************************************************
+  StoreWriter::~StoreWriter()
+  {
+    if (this->fd >= 0)
+    {
+      flush();
+      close(this->fd);
+    }
+
+    if (this->index_fd >= 0)
+    {
+      close(this->index_fd);
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This method creates a store, or opens an existing one. When appending,
+  //  the last block is loaded back if it is not full, and the index file
+  //  is rewritten from the block headers, so it is consistent with the
+  //  store even if the previous writer was stopped between both writes.
+  //
+  //*****************************************************************************
+  bool StoreWriter::open(const char* path, uint32_t cpu_cnt)
+  {
+    struct stat info;
+
+    this->fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (this->fd < 0 || fstat(this->fd, &info) < 0)
+    {
+      this->error = "cannot be open.";
+      return false;
+    }
+
+    std::string index_path = std::string(path) + ".idx";
+    this->index_fd = ::open(index_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (this->index_fd < 0)
+    {
+      this->error = "index cannot be open.";
+      return false;
+    }
+
+    uint32_t block_cnt = 0;
+
+    if (info.st_size == 0)
+    {
+      //
+      //  New store: the block header holds the summaries
+      //  of every CPU, and the block every sample.
+      //
+      memcpy(this->header.magic, STORE_MAGIC, sizeof(STORE_MAGIC));
+      this->header.version = STORE_VERSION;
+      this->header.cpu_cnt = cpu_cnt;
+      this->header.header_size = static_cast<uint32_t>(round_to_pages(
+        sizeof(BlockHeader) + cpu_cnt * (sizeof(uint64_t) + sizeof(uint32_t) + 2 * sizeof(uint16_t))));
+      this->header.block_size = round_to_pages(
+        this->header.header_size + this->header.block_samples *
+        (sizeof(uint64_t) + static_cast<size_t>(cpu_cnt) * sizeof(uint16_t)));
+
+      std::vector<char> page(FILE_HEADER_SIZE, 0);
+      memcpy(&page[0], &this->header, sizeof(this->header));
+
+      if (!write_at(this->fd, &page[0], page.size(), 0))
+      {
+        this->error = "cannot be written.";
+        return false;
+      }
+    }
+    else
+    {
+      if (pread(this->fd, &this->header, sizeof(this->header), 0) != sizeof(this->header) ||
+          !is_valid_header(this->header))
+      {
+        this->error = "is not a store.";
+        return false;
+      }
+
+      if (this->header.cpu_cnt != cpu_cnt)
+      {
+        this->error = "was recorded with " + std::to_string(this->header.cpu_cnt) + " CPUs.";
+        return false;
+      }
+
+      block_cnt = static_cast<uint32_t>((info.st_size - FILE_HEADER_SIZE) / this->header.block_size);
+    }
+
+    this->block.assign(this->header.block_size, 0);
+    this->values.assign(cpu_cnt, 0);
+
+    //
+    //  Rebuild the index from the headers of the blocks,
+    //  and load the last block back if it is not full.
+    //
+    std::vector<IndexEntry> entries;
+    BlockHeader block_header;
+
+    for (uint32_t i = 0; i < block_cnt; i++)
+    {
+      off_t offset = FILE_HEADER_SIZE + static_cast<off_t>(i) * this->header.block_size;
+
+      if (pread(this->fd, &block_header, sizeof(block_header), offset) != sizeof(block_header) ||
+          block_header.sample_cnt == 0)
+      {
+        break;
+      }
+
+      entries.push_back({block_header.first_ms, block_header.last_ms});
+      this->last_ms = block_header.last_ms;
+      this->block_idx = i + 1;
+
+      if (block_header.sample_cnt < this->header.block_samples)
+      {
+        if (pread(this->fd, &this->block[0], this->block.size(), offset) !=
+            static_cast<ssize_t>(this->block.size()))
+        {
+          this->error = "cannot be read.";
+          return false;
+        }
+
+        this->block_idx = i;
+        break;
+      }
+    }
+
+    if (!entries.empty() &&
+        !write_at(this->index_fd, &entries[0], entries.size() * sizeof(IndexEntry), 0))
+    {
+      this->error = "index cannot be written.";
+      return false;
+    }
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method appends a sample to the block being filled, and updates
+  //  the summaries of the CPUs that are not offline. A full block is
+  //  written and a new one started.
+  //
+  //*****************************************************************************
+  bool StoreWriter::append(uint64_t time_ms, const uint16_t* values)
+  {
+    if (this->failed || this->fd < 0 || time_ms <= this->last_ms)
+    {
+      return !this->failed;
+    }
+
+    char* block = &this->block[0];
+    BlockHeader* block_header = reinterpret_cast<BlockHeader*>(block);
+    uint64_t* sums = reinterpret_cast<uint64_t*>(block + get_sums_offset(this->header));
+    uint32_t* counts = reinterpret_cast<uint32_t*>(block + get_counts_offset(this->header));
+    uint16_t* mins = reinterpret_cast<uint16_t*>(block + get_mins_offset(this->header));
+    uint16_t* maxs = reinterpret_cast<uint16_t*>(block + get_maxs_offset(this->header));
+    uint64_t* times = reinterpret_cast<uint64_t*>(block + get_times_offset(this->header));
+    uint32_t sample_idx = block_header->sample_cnt;
+
+    if (sample_idx == 0)
+    {
+      block_header->first_ms = time_ms;
+    }
+
+    times[sample_idx] = time_ms;
+
+    for (uint32_t i = 0; i < this->header.cpu_cnt; i++)
+    {
+      uint16_t value = values[i];
+      uint16_t* column = reinterpret_cast<uint16_t*>(block + get_values_offset(this->header, i));
+
+      column[sample_idx] = value;
+
+      if (value == OFFLINE)
+      {
+        continue;
+      }
+
+      sums[i] += value;
+      mins[i] = (counts[i] == 0 || value < mins[i]) ? value : mins[i];
+      maxs[i] = (value > maxs[i]) ? value : maxs[i];
+      counts[i]++;
+    }
+
+    block_header->last_ms = time_ms;
+    block_header->sample_cnt++;
+    this->last_ms = time_ms;
+
+    if (block_header->sample_cnt == this->header.block_samples)
+    {
+      write_block();
+      this->block_idx++;
+      this->flush_time = time_ms;
+      reset_block();
+    }
+    else if ((time_ms - this->flush_time) >= FLUSH_PERIOD)
+    {
+      write_block();
+      this->flush_time = time_ms;
+    }
+
+    return !this->failed;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method converts the busy percentage of every CPU of a sample to
+  //  tenths and appends them. CPUs missing from the sample (offline) are
+  //  stored as OFFLINE.
+  //
+  //*****************************************************************************
+  bool StoreWriter::write(const Sample &sample)
+  {
+    if (sample.sequence == 0)
+    {
+      return !this->failed;
+    }
+
+    for (uint32_t i = 0; i < this->header.cpu_cnt; i++)
+    {
+      if (i >= sample.cpu_cnt || !sample.cpu[i].is_online())
+      {
+        this->values[i] = OFFLINE;
+        continue;
+      }
+
+      this->values[i] = static_cast<uint16_t>(sample.cpu[i].get_interval_busy_pct() * 10 + 0.5f);
+    }
+
+    return append(sample.wall_time / 1000000, this->values.data());
+  }
+
+  //*****************************************************************************
+  //
+  //  This static method writes a sample with the writer given as context.
+  //  Write errors are kept in the writer and checked with has_failed.
+  //
+  //*****************************************************************************
+  void StoreWriter::on_sample(const Sample &sample, void* context)
+  {
+    static_cast<StoreWriter*>(context)->write(sample);
+  }
+
+  //*****************************************************************************
+  //
+  //  This method writes the block being filled, if it holds any sample.
+  //
+  //*****************************************************************************
+  bool StoreWriter::flush(void)
+  {
+    if (this->fd >= 0 && !this->block.empty() &&
+        reinterpret_cast<const BlockHeader*>(&this->block[0])->sample_cnt > 0)
+    {
+      write_block();
+    }
+
+    return !this->failed;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the last error.
+  //
+  //*****************************************************************************
+  const std::string &StoreWriter::get_error(void) const
+  {
+    return this->error;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns true if a previous write failed.
+  //
+  //*****************************************************************************
+  bool StoreWriter::has_failed(void) const
+  {
+    return this->failed;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method writes the block being filled at its place, and
+  //  then its index entry. The block is written first, so an index entry
+  //  never points to a block that is not on disk.
+  //
+  //*****************************************************************************
+  bool StoreWriter::write_block(void)
+  {
+    const BlockHeader* block_header = reinterpret_cast<const BlockHeader*>(&this->block[0]);
+    IndexEntry entry = {block_header->first_ms, block_header->last_ms};
+    off_t offset = FILE_HEADER_SIZE + static_cast<off_t>(this->block_idx) * this->header.block_size;
+
+    if (!write_at(this->fd, &this->block[0], this->block.size(), offset) ||
+        !write_at(this->index_fd, &entry, sizeof(entry),
+                  static_cast<off_t>(this->block_idx) * sizeof(entry)))
+    {
+      this->failed = true;
+    }
+
+    return !this->failed;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method clears the block being filled.
+  //
+  //*****************************************************************************
+  void StoreWriter::reset_block(void)
+  {
+    memset(&this->block[0], 0, this->block.size());
+  }
+
+  //*****************************************************************************
+  //
+  //  Constructor: Initialize empty mappings.
+  //
+  //*****************************************************************************
+  StoreReader::StoreReader()
+    : map(nullptr), size(0), index_map(nullptr), index_size(0), header(nullptr),
+      block_cnt(0), index(nullptr), scanned(0)
+  {
+
+  }
+
+  //*****************************************************************************
+  //
+  //  Destructor: Unmap the files.
+  //
+  //*****************************************************************************
+  StoreReader::~StoreReader()
+  {
+    if (this->map)
+    {
+      munmap(const_cast<char*>(this->map), this->size);
+    }
+
+    if (this->index_map)
+    {
+      munmap(const_cast<char*>(this->index_map), this->index_size);
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This method maps the store and its index. The blocks are accessed at
+  //  random, so the kernel is told not to read ahead. The index is used if
+  //  it has one entry per block and its last entry matches the last block,
+  //  otherwise it is rebuilt from the block headers.
+  //
+  //*****************************************************************************
+  bool StoreReader::open(const char* path)
+  {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    struct stat info;
+
+    if (fd < 0 || fstat(fd, &info) < 0)
+    {
+      this->error = "cannot be open.";
+      return false;
+    }
+
+    if (static_cast<size_t>(info.st_size) < FILE_HEADER_SIZE)
+    {
+      close(fd);
+      this->error = "is not a store.";
+      return false;
+    }
+
+    void* map = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+    {
+      this->error = "cannot be mapped.";
+      return false;
+    }
+
+    madvise(map, info.st_size, MADV_RANDOM);
+    this->map = static_cast<const char*>(map);
+    this->size = info.st_size;
+    this->header = reinterpret_cast<const StoreHeader*>(this->map);
+
+    if (!is_valid_header(*this->header))
+    {
+      this->error = "is not a store.";
+      return false;
+    }
+
+    this->block_cnt = static_cast<uint32_t>((this->size - FILE_HEADER_SIZE) / this->header->block_size);
+
+    //
+    //  Blocks allocated but never filled (e.g. the
+    //  writer stopped while writing) are left out.
+    //
+    while (this->block_cnt > 0 && get_block(this->block_cnt - 1)->sample_cnt == 0)
+    {
+      this->block_cnt--;
+    }
+
+    std::string index_path = std::string(path) + ".idx";
+    fd = ::open(index_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd >= 0 && fstat(fd, &info) == 0 &&
+        static_cast<size_t>(info.st_size) == this->block_cnt * sizeof(IndexEntry) && this->block_cnt > 0)
+    {
+      map = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+      if (map != MAP_FAILED)
+      {
+        this->index_map = static_cast<const char*>(map);
+        this->index_size = info.st_size;
+        this->index = reinterpret_cast<const IndexEntry*>(this->index_map);
+
+        if (this->index[this->block_cnt - 1].first_ms != get_block(this->block_cnt - 1)->first_ms ||
+            this->index[this->block_cnt - 1].last_ms != get_block(this->block_cnt - 1)->last_ms)
+        {
+          this->index = nullptr;
+        }
+      }
+    }
+
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+
+    if (!this->index)
+    {
+      this->rebuilt_index.clear();
+
+      for (uint32_t i = 0; i < this->block_cnt; i++)
+      {
+        this->rebuilt_index.push_back({get_block(i)->first_ms, get_block(i)->last_ms});
+      }
+
+      this->index = this->rebuilt_index.data();
+    }
+
+    return true;
+  }
+
+  //*****************************************************************************
+  //
+  //  These methods return the number of CPUs and blocks of the store.
+  //
+  //*****************************************************************************
+  uint32_t StoreReader::get_cpu_count(void) const
+  {
+    return this->header ? this->header->cpu_cnt : 0;
+  }
+
+  uint32_t StoreReader::get_block_count(void) const
+  {
+    return this->block_cnt;
+  }
+
+  //*****************************************************************************
+  //
+  //  These methods return the time of the first and last samples, or 0 if
+  //  the store is empty.
+  //
+  //*****************************************************************************
+  uint64_t StoreReader::get_first_time(void) const
+  {
+    return this->block_cnt ? this->index[0].first_ms : 0;
+  }
+
+  uint64_t StoreReader::get_last_time(void) const
+  {
+    return this->block_cnt ? this->index[this->block_cnt - 1].last_ms : 0;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the number of blocks whose samples were scanned
+  //  by the last query, the others being answered from their summaries.
+  //
+  //*****************************************************************************
+  uint32_t StoreReader::get_scanned_count(void) const
+  {
+    return this->scanned;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the last error.
+  //
+  //*****************************************************************************
+  const std::string &StoreReader::get_error(void) const
+  {
+    return this->error;
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the maximum busy percentage of a CPU in a range.
+  //
+  //*****************************************************************************
+  bool StoreReader::get_max(uint32_t cpu, uint64_t from_ms, uint64_t to_ms, float &max)
+  {
+    Summary summary = {0, 0, 0};
+
+    summarize(cpu, from_ms, to_ms, summary);
+    max = summary.max / 10.0f;
+
+    return (summary.count > 0);
+  }
+
+  //*****************************************************************************
+  //
+  //  This method returns the mean busy percentage of a CPU in a range.
+  //
+  //*****************************************************************************
+  bool StoreReader::get_mean(uint32_t cpu, uint64_t from_ms, uint64_t to_ms, float &mean)
+  {
+    Summary summary = {0, 0, 0};
+
+    summarize(cpu, from_ms, to_ms, summary);
+    mean = summary.count ? (static_cast<float>(summary.sum) / summary.count / 10.0f) : 0;
+
+    return (summary.count > 0);
+  }
+
+  //*****************************************************************************
+  //
+  //  This method lists the CPUs whose busy percentage went over a threshold
+  //  in a range. For the blocks fully inside the range, the maximum of
+  //  every CPU is read from the summaries. The threshold is converted to
+  //  tenths within the range of the values, so a negative one lists every
+  //  CPU with a sample over 0 and one too large (or NaN) lists none.
+  //
+  //*****************************************************************************
+  void StoreReader::get_cpus_over(float threshold, uint64_t from_ms, uint64_t to_ms,
+                                  std::vector<uint32_t> &cpus)
+  {
+    uint32_t cpu_cnt = get_cpu_count();
+    float tenths = threshold * 10 + 0.5f;
+    uint16_t limit = StoreWriter::OFFLINE;
+
+    if (tenths < StoreWriter::OFFLINE)
+    {
+      limit = (tenths > 0) ? static_cast<uint16_t>(tenths) : 0;
+    }
+    std::vector<uint8_t> over(cpu_cnt, 0);
+    uint32_t first;
+    uint32_t end;
+
+    cpus.clear();
+    this->scanned = 0;
+    find_blocks(from_ms, to_ms, first, end);
+    prefetch_headers(first, end);
+
+    for (uint32_t i = first; i < end; i++)
+    {
+      const BlockHeader* block_header = get_block(i);
+      const char* block = reinterpret_cast<const char*>(block_header);
+
+      if (block_header->first_ms >= from_ms && block_header->last_ms <= to_ms)
+      {
+        const uint16_t* maxs = reinterpret_cast<const uint16_t*>(block + get_maxs_offset(*this->header));
+
+        for (uint32_t j = 0; j < cpu_cnt; j++)
+        {
+          over[j] |= (maxs[j] > limit);
+        }
+        continue;
+      }
+
+      //
+      //  Edge block: scan the samples in the range.
+      //
+      const uint64_t* times = reinterpret_cast<const uint64_t*>(block + get_times_offset(*this->header));
+      uint32_t sample_cnt = get_sample_count(*this->header, *block_header);
+      uint32_t begin = std::lower_bound(times, times + sample_cnt, from_ms) - times;
+      uint32_t finish = std::upper_bound(times, times + sample_cnt, to_ms) - times;
+
+      this->scanned++;
+
+      for (uint32_t j = 0; j < cpu_cnt; j++)
+      {
+        const uint16_t* column = reinterpret_cast<const uint16_t*>(block + get_values_offset(*this->header, j));
+
+        for (uint32_t k = begin; k < finish && !over[j]; k++)
+        {
+          over[j] = (column[k] > limit) && (column[k] != StoreWriter::OFFLINE);
+        }
+      }
+    }
+
+    for (uint32_t j = 0; j < cpu_cnt; j++)
+    {
+      if (over[j])
+      {
+        cpus.push_back(j);
+      }
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method returns the header of a block.
+  //
+  //*****************************************************************************
+  const BlockHeader* StoreReader::get_block(uint32_t block_idx) const
+  {
+    return reinterpret_cast<const BlockHeader*>(this->map + FILE_HEADER_SIZE +
+                                                static_cast<size_t>(block_idx) * this->header->block_size);
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method finds the blocks overlapping a range with two
+  //  binary searches on the index: the first block ending after the start
+  //  of the range, and the first block starting after its end.
+  //
+  //*****************************************************************************
+  void StoreReader::find_blocks(uint64_t from_ms, uint64_t to_ms, uint32_t &first, uint32_t &end) const
+  {
+    const IndexEntry* index_end = this->index + this->block_cnt;
+
+    first = std::lower_bound(this->index, index_end, from_ms,
+                             [](const IndexEntry &entry, uint64_t time_ms)
+                             {
+                               return entry.last_ms < time_ms;
+                             }) - this->index;
+
+    end = std::upper_bound(this->index, index_end, to_ms,
+                           [](uint64_t time_ms, const IndexEntry &entry)
+                           {
+                             return time_ms < entry.first_ms;
+                           }) - this->index;
+
+    end = (end < first) ? first : end;
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method asks the kernel to read the headers of a range of
+  //  blocks ahead. The headers are one block apart, so reading them on
+  //  demand waits for the disk once per block, while the requests made here
+  //  are queued at once. If the header of the first block is already in
+  //  memory the range is taken as cached, so a query repeated on cached
+  //  data does not pay a system call per block.
+  //
+  //*****************************************************************************
+  void StoreReader::prefetch_headers(uint32_t first, uint32_t end) const
+  {
+    unsigned char resident = 0;
+
+    if (end - first < 2 ||
+        mincore(const_cast<BlockHeader*>(get_block(first)), PAGE_SIZE, &resident) < 0 ||
+        (resident & 1))
+    {
+      return;
+    }
+
+    for (uint32_t i = first; i < end; i++)
+    {
+      madvise(const_cast<BlockHeader*>(get_block(i)), this->header->header_size, MADV_WILLNEED);
+    }
+  }
+
+  //*****************************************************************************
+  //
+  //  This private method summarizes the samples of a CPU in a range. The
+  //  blocks fully inside the range add their summary, and the edge blocks
+  //  the samples found by a binary search on their times. The samples where
+  //  the CPU was offline are left out.
+  //
+  //*****************************************************************************
+  void StoreReader::summarize(uint32_t cpu, uint64_t from_ms, uint64_t to_ms, Summary &summary)
+  {
+    uint32_t first;
+    uint32_t end;
+
+    this->scanned = 0;
+
+    if (cpu >= get_cpu_count())
+    {
+      return;
+    }
+
+    find_blocks(from_ms, to_ms, first, end);
+    prefetch_headers(first, end);
+
+    for (uint32_t i = first; i < end; i++)
+    {
+      const BlockHeader* block_header = get_block(i);
+      const char* block = reinterpret_cast<const char*>(block_header);
+
+      if (block_header->first_ms >= from_ms && block_header->last_ms <= to_ms)
+      {
+        const uint64_t* sums = reinterpret_cast<const uint64_t*>(block + get_sums_offset(*this->header));
+        const uint32_t* counts = reinterpret_cast<const uint32_t*>(block + get_counts_offset(*this->header));
+        const uint16_t* maxs = reinterpret_cast<const uint16_t*>(block + get_maxs_offset(*this->header));
+
+        summary.count += counts[cpu];
+        summary.sum += sums[cpu];
+        summary.max = (maxs[cpu] > summary.max) ? maxs[cpu] : summary.max;
+        continue;
+      }
+
+      const uint64_t* times = reinterpret_cast<const uint64_t*>(block + get_times_offset(*this->header));
+      const uint16_t* column = reinterpret_cast<const uint16_t*>(block + get_values_offset(*this->header, cpu));
+      uint32_t sample_cnt = get_sample_count(*this->header, *block_header);
+      uint32_t begin = std::lower_bound(times, times + sample_cnt, from_ms) - times;
+      uint32_t finish = std::upper_bound(times, times + sample_cnt, to_ms) - times;
+
+      this->scanned++;
+
+      for (uint32_t k = begin; k < finish; k++)
+      {
+        if (column[k] == StoreWriter::OFFLINE)
+        {
+          continue;
+        }
+
+        summary.count++;
+        summary.sum += column[k];
+        summary.max = (column[k] > summary.max) ? column[k] : summary.max;
+      }
+    }
+  }
+}
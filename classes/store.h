@@ -0,0 +1,228 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     store.h
+//
+//*****************************************************************************
+
+#ifndef __STORE_H__
+#define __STORE_H__
+
+namespace procstat
+{
+  //*****************************************************************************
+  //
+  //  Store file header, at the start of the file.
+  //  magic - "PSTSTORE".
+  //  version - layout version, STORE_VERSION.
+  //  cpu_cnt - number of CPUs of every sample.
+  //  block_samples - number of samples of every block.
+  //  header_size - bytes of the block header, rounded up to a page.
+  //  block_size - bytes of every block, rounded up to a page.
+  //
+  //*****************************************************************************
+  struct StoreHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t cpu_cnt;
+    uint32_t block_samples;
+    uint32_t header_size;
+    uint64_t block_size;
+  };
+
+  //*****************************************************************************
+  //
+  //  Block header, at the start of every block and followed by the summaries
+  //  of every CPU: the sum (uint64_t), count (uint32_t), minimum and maximum
+  //  (uint16_t) of the busy percentages in tenths, leaving out the samples
+  //  where the CPU was offline.
+  //  first_ms, last_ms - wall time of the first and last samples.
+  //  sample_cnt - number of samples in the block, the last block of the
+  //               file being the only one that can be partially filled.
+  //
+  //*****************************************************************************
+  struct BlockHeader
+  {
+    uint64_t first_ms;
+    uint64_t last_ms;
+    uint32_t sample_cnt;
+    uint32_t reserved;
+  };
+
+  //*****************************************************************************
+  //
+  //  Sparse time index entry, one per block in the "PATH.idx" file.
+  //
+  //*****************************************************************************
+  struct IndexEntry
+  {
+    uint64_t first_ms;
+    uint64_t last_ms;
+  };
+
+  //*****************************************************************************
+  //
+  //  StoreWriter class.
+  //  This class records the busy percentage of every CPU, in tenths, into
+  //  a store file made of fixed-size blocks. Every block holds its header
+  //  and the CPU summaries, then the sample times, then the values of every
+  //  CPU one after the other, so a query on a single CPU reads a contiguous
+  //  range. The block being filled is kept in memory and written when full,
+  //  every minute, and when the writer is destroyed.
+  //
+  //*****************************************************************************
+  class StoreWriter
+  {
+    public:
+      //
+      //  Constructor and destructor. The destructor writes the block
+      //  being filled and closes the files.
+      //
+      StoreWriter(uint32_t block_samples = 4096);
+      ~StoreWriter();
+
+      //
+      //  The StoreWriter owns file descriptors, so it cannot be copied.
+      //
+      StoreWriter(const StoreWriter &) = delete;
+      StoreWriter &operator=(const StoreWriter &) = delete;
+
+      //
+      //  Value stored for a CPU missing from a sample (offline).
+      //
+      static const uint16_t OFFLINE = 0xFFFF;
+
+      //
+      //  Create a store, or open an existing one with the same number of
+      //  CPUs to append to it. Returns false on error, see get_error.
+      //
+      bool open(const char* path, uint32_t cpu_cnt);
+
+      //
+      //  Append the busy percentages (in tenths, or OFFLINE) of a sample.
+      //  Samples not later than the previous one are ignored. Returns false
+      //  on a write error.
+      //
+      bool append(uint64_t time_ms, const uint16_t* values);
+
+      //
+      //  Append a sample from the sampler. The first sample is skipped, as
+      //  its percentages are since boot. The static version can be given
+      //  to Sampler::subscribe with the writer as context.
+      //
+      bool write(const Sample &sample);
+      static void on_sample(const Sample &sample, void* context);
+
+      //
+      //  Write the block being filled and its index entry.
+      //
+      bool flush(void);
+
+      //
+      //  Getter methods for the last error and the write error state.
+      //
+      const std::string &get_error(void) const;
+      bool has_failed(void) const;
+    private:
+      int fd;
+      int index_fd;
+      StoreHeader header;
+      uint32_t block_idx;
+      uint64_t last_ms;
+      uint64_t flush_time;
+      bool failed;
+      std::string error;
+      std::vector<char> block;
+      std::vector<uint16_t> values;
+
+      bool write_block(void);
+      void reset_block(void);
+  };
+
+  //*****************************************************************************
+  //
+  //  StoreReader class.
+  //  This class maps a store file and its index in memory and answers range
+  //  queries. The blocks overlapping a range are found by a binary search on
+  //  the index. The blocks fully inside the range are answered from their
+  //  summaries, so only their headers are read, and only the (at most two)
+  //  blocks at the edges of the range have their samples scanned.
+  //
+  //*****************************************************************************
+  class StoreReader
+  {
+    public:
+      //
+      //  Constructor and destructor. The destructor unmaps the files.
+      //
+      StoreReader();
+      ~StoreReader();
+
+      //
+      //  The StoreReader owns the file mappings, so it cannot be copied.
+      //
+      StoreReader(const StoreReader &) = delete;
+      StoreReader &operator=(const StoreReader &) = delete;
+
+      //
+      //  Map a store file. If the index file is missing or out of date, it
+      //  is rebuilt in memory from the block headers. Returns false on
+      //  error, see get_error.
+      //
+      bool open(const char* path);
+
+      //
+      //  Getter methods for the number of CPUs and blocks, the time of the
+      //  first and last samples, the number of blocks whose samples were
+      //  scanned by the last query, and the last error.
+      //
+      uint32_t get_cpu_count(void) const;
+      uint32_t get_block_count(void) const;
+      uint64_t get_first_time(void) const;
+      uint64_t get_last_time(void) const;
+      uint32_t get_scanned_count(void) const;
+      const std::string &get_error(void) const;
+
+      //
+      //  Queries on the busy percentage of a CPU between two wall times
+      //  (both included): the maximum and the mean. Return false if no
+      //  sample is in the range, or the CPU was offline in all of them.
+      //
+      bool get_max(uint32_t cpu, uint64_t from_ms, uint64_t to_ms, float &max);
+      bool get_mean(uint32_t cpu, uint64_t from_ms, uint64_t to_ms, float &mean);
+
+      //
+      //  Query on the CPUs whose busy percentage went over a threshold
+      //  between two wall times.
+      //
+      void get_cpus_over(float threshold, uint64_t from_ms, uint64_t to_ms,
+                         std::vector<uint32_t> &cpus);
+    private:
+      struct Summary
+      {
+        uint64_t count;
+        uint64_t sum;
+        uint16_t max;
+      };
+
+      const char* map;
+      size_t size;
+      const char* index_map;
+      size_t index_size;
+      const StoreHeader* header;
+      uint32_t block_cnt;
+      const IndexEntry* index;
+      std::vector<IndexEntry> rebuilt_index;
+      uint32_t scanned;
+      std::string error;
+
+      const BlockHeader* get_block(uint32_t block_idx) const;
+      void find_blocks(uint64_t from_ms, uint64_t to_ms, uint32_t &first, uint32_t &end) const;
+      void prefetch_headers(uint32_t first, uint32_t end) const;
+      void summarize(uint32_t cpu, uint64_t from_ms, uint64_t to_ms, Summary &summary);
+  };
+}
+
+#endif  // __STORE_H__
@@ -31,7 +31,8 @@ namespace procstat
   //  initilize to avoid future calls returning values different than zero.
   //
   //*****************************************************************************
-  System::System() : page_data {0, 1}, swap_data {0, 1}
+  System::System()
+    : page_data {0, 1}, swap_data {0, 1}, intr_count(0), ctxt_count(0), btime_data(0)
   {
 
   }
@@ -73,7 +74,7 @@ namespace procstat
   //*****************************************************************************
   void System::set_intr_data(uint64_t* data)
   {
-    this->intr_data = std::to_string(*data);
+    this->intr_count = *data;
   }
 
   //*****************************************************************************
@@ -83,7 +84,7 @@ namespace procstat
   //*****************************************************************************
   void System::set_ctxt_data(uint64_t* data)
   {
-    this->ctxt_data = std::to_string(*data);
+    this->ctxt_count = *data;
   }
 
   //*****************************************************************************
@@ -103,7 +104,7 @@ namespace procstat
   //  page_data[1] - written out.
   //
   //*****************************************************************************
-  float System::get_page_ratio(void)
+  float System::get_page_ratio(void) const
   {
     return (static_cast<float>(page_data[0]) / page_data[1]);
   }
@@ -115,7 +116,7 @@ namespace procstat
   //  swap_data[1] - written out.
   //
   //*****************************************************************************
-  float System::get_swap_ratio(void)
+  float System::get_swap_ratio(void) const
   {
     return (static_cast<float>(swap_data[0]) / swap_data[1]);
   }
@@ -124,11 +125,12 @@ namespace procstat
   //
   //  This method returns a formatted string that indicates the number of
   //  interrupts serviced since boot time (e.g. "16.47 millions since booting").
+  //  The number is only converted to a string here, not on every sample.
   //
   //*****************************************************************************
-  std::string System::get_intr_serviced(void)
+  std::string System::get_intr_serviced(void) const
   {
-    return string_formatting(intr_data);
+    return string_formatting(std::to_string(this->intr_count));
   }
 
   //*****************************************************************************
@@ -137,9 +139,25 @@ namespace procstat
   //  of context switches across all CPUs (e.g. "1.54 billions since booting").
   //
   //*****************************************************************************
-  std::string System::get_ctxt_switch_count(void)
+  std::string System::get_ctxt_switch_count(void) const
   {
-    return string_formatting(ctxt_data);
+    return string_formatting(std::to_string(this->ctxt_count));
+  }
+
+  //*****************************************************************************
+  //
+  //  These methods return the number of interrupts serviced and the total
+  //  number of context switches since boot time.
+  //
+  //*****************************************************************************
+  uint64_t System::get_intr_count(void) const
+  {
+    return this->intr_count;
+  }
+
+  uint64_t System::get_ctxt_count(void) const
+  {
+    return this->ctxt_count;
   }
 
   //*****************************************************************************
@@ -149,7 +167,7 @@ namespace procstat
   //  switches and interrupts serviced since boot time.
   //
   //*****************************************************************************
-  std::string System::string_formatting(std::string str)
+  std::string System::string_formatting(std::string str) const
   {
     uint8_t i;
     uint8_t magnitud;
@@ -47,22 +47,29 @@ namespace procstat
       //
       //  Getter methods for the pages and swap pages in/out ratio.
       //
-      float get_page_ratio(void);
-      float get_swap_ratio(void);
+      float get_page_ratio(void) const;
+      float get_swap_ratio(void) const;
 
       //
       //  Getter methods for the number of interrupts serviced and context switches
       //  since booting in an string format (e.g. "1.54 billions since booting").
       //
-      std::string get_intr_serviced(void);
-      std::string get_ctxt_switch_count(void);
+      std::string get_intr_serviced(void) const;
+      std::string get_ctxt_switch_count(void) const;
+
+      //
+      //  Getter methods for the number of interrupts serviced and context
+      //  switches since booting as plain numbers.
+      //
+      uint64_t get_intr_count(void) const;
+      uint64_t get_ctxt_count(void) const;
     private:
       uint32_t page_data[2];
       uint32_t swap_data[2];
-      std::string intr_data;
-      std::string ctxt_data;
+      uint64_t intr_count;
+      uint64_t ctxt_count;
       uint32_t btime_data;
-      std::string string_formatting(std::string str);
+      std::string string_formatting(std::string str) const;
   };
 }
 
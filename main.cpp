@@ -7,14 +7,14 @@
 //
 #include <fstream>
 //
-//  Stream class to operate on strings.
-//
-#include <sstream>
-//
 //  Standard string class.
 //
 #include <string>
 //
+//  C string handling functions.
+//
+#include <cstring>
+//
 //  Header providing parametric manipulators.
 //
 #include <iomanip>
@@ -27,9 +27,24 @@
 //
 #include <cstdlib>
 //
-//  POSIX operating system API for usleep.
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Atomic operations library.
+//
+#include <atomic>
+//
+//  POSIX operating system API for close, and file control for open.
 //
 #include <unistd.h>
+#include <fcntl.h>
+//
+//  Linux I/O event notification facility and signal file descriptors.
+//
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <signal.h>
 //
 //  CPU class.
 //
@@ -42,253 +57,673 @@
 //  Parser class.
 //
 #include "classes/parser.h"
+//
+//  Chunk parser class.
+//
+#include "classes/chunk_parser.h"
+//
+//  Sampler class.
+//
+#include "classes/sampler.h"
+//
+//  Profiler class.
+//
+#include "classes/profiler.h"
+//
+//  Rule engine class.
+//
+#include "classes/rules.h"
+//
+//  Exporter class.
+//
+#include "classes/exporter.h"
+//
+//  Capture reader and writer classes.
+//
+#include "classes/capture.h"
+//
+//  Store reader and writer classes.
+//
+#include "classes/store.h"
+//
+//  Heatmap class.
+//
+#include "classes/heatmap.h"
+//
+//  Daemon class.
+//
+#include "classes/daemon.h"
 
 //*****************************************************************************
 //
-//  Main Function.
+//  Command line options.
+//  self_stats - display the self statistics panel below the table.
+//  self_stats_file - file where the self statistics are appended as JSON.
+//  rules_path - rules file evaluated on every sample.
+//  events_file - file where the rule events are appended, stdout if closed.
+//  interval_ms - sampling period in milliseconds.
+//  adaptive - adapt the sampling period between adaptive_config bounds.
+//  export_format - write the samples to stdout in this format instead of
+//                  displaying the table, if export_enabled is set.
+//  parse_threads - maximum threads to parse large snapshots, 0 for default.
+//  capture_fd - file where the raw snapshots are appended, -1 if none.
+//  record_path - store where the busy percentages are recorded.
+//  heatmap - display one colored cell per CPU instead of the table.
+//  daemon - run without display, at low priority and with the memory locked.
+//  pin_cpu - CPU the monitor runs on, -1 for any.
+//  nice_set, nice - nice level instead of the SCHED_IDLE policy.
+//  budget_pct - CPU usage budget in percentage of one CPU, 0 for none.
 //
 //*****************************************************************************
-int main(int argc, char const *argv[])
+struct Options
 {
-  std::ifstream fs;
-  std::string line;
+  uint32_t interval_ms = 500;
+  bool adaptive = false;
+  procstat::AdaptiveConfig adaptive_config = {0, 0, 80, 20, 50000, 5000,
+                                              procstat::Fingerprint::Busy};
+  bool export_enabled = false;
+  procstat::Format export_format = procstat::Format::Csv;
+  bool self_stats = false;
+  std::ofstream self_stats_file;
+  uint64_t self_stats_time = 0;
+  const char* rules_path = nullptr;
+  std::ofstream events_file;
+  uint32_t parse_threads = 0;
+  int capture_fd = -1;
+  const char* record_path = nullptr;
+  bool heatmap = false;
+  bool daemon = false;
+  int32_t pin_cpu = -1;
+  bool nice_set = false;
+  int32_t nice = 0;
+  float budget_pct = 0;
+};
+
+//*****************************************************************************
+//
+//  This function displays the command line usage.
+//
+//*****************************************************************************
+static void print_usage(const char* name)
+{
+  std::cerr << "Usage: " << name << " [options]" << std::endl;
+  std::cerr << "  --interval MS            sampling period in milliseconds (default 500)" << std::endl;
+  std::cerr << "  --adaptive MIN,MAX       adapt the sampling period between MIN and MAX ms," << std::endl;
+  std::cerr << "                           skipping the parse and output if nothing changed" << std::endl;
+  std::cerr << "  --format csv|json        write one CSV row or JSON line per sample to stdout" << std::endl;
+  std::cerr << "  --heatmap                display one colored cell per CPU, grouped by socket" << std::endl;
+  std::cerr << "  --self-stats             display the monitor's own cost" << std::endl;
+  std::cerr << "  --self-stats-file PATH   append the monitor's own cost as JSON lines" << std::endl;
+  std::cerr << "  --rules PATH             evaluate the threshold rules in PATH" << std::endl;
+  std::cerr << "  --events PATH            append the rule events to PATH (default stdout," << std::endl;
+  std::cerr << "                           or stderr with --format)" << std::endl;
+  std::cerr << "  --parse-threads N        maximum threads to parse large snapshots" << std::endl;
+  std::cerr << "                           (default the number of CPUs it may run on)" << std::endl;
+  std::cerr << "  --capture PATH           append the raw snapshots to PATH, to be merged" << std::endl;
+  std::cerr << "                           with other hosts by procstat-merge" << std::endl;
+  std::cerr << "  --record PATH            record the busy percentages in the store PATH," << std::endl;
+  std::cerr << "                           to be queried by procstat-query" << std::endl;
+  std::cerr << "  --daemon                 run without display at the SCHED_IDLE policy, with" << std::endl;
+  std::cerr << "                           the memory locked and a 1% CPU budget by default" << std::endl;
+  std::cerr << "  --pin CPU                run the monitor on CPU only" << std::endl;
+  std::cerr << "  --nice N                 run at nice level N instead of SCHED_IDLE" << std::endl;
+  std::cerr << "  --budget PCT             lengthen the sampling period to keep the monitor" << std::endl;
+  std::cerr << "                           under PCT% of one CPU" << std::endl;
+}
+
+//*****************************************************************************
+//
+//  This function displays the CPUs percentage of execution time and the
+//  general system information of a sample. It is subscribed to the sampler
+//  and called once per sample.
+//
+//*****************************************************************************
+static void render_table(const procstat::Sample &sample, void* context)
+{
+  Options* options = static_cast<Options*>(context);
+  uint64_t start = PROCSTAT_TICKS();
+  const procstat::Cpu* cpu = sample.cpu;
+  const procstat::System &system = *sample.system;
 
   //
-  //  Parser object to parse a single file
-  //  line into a label and data.
+  //  Default values for the output format.
   //
-  procstat::Parser parser;
+  uint8_t fixed_precision = 6;
+  uint8_t fixed_width = 12;
 
   //
-  //  Elements contained in a file line.
+  //  Clean the previous screen and print the new results.
   //
-  procstat::Label label;
-  uint64_t* data = nullptr;
-
+  std::cout << "\e[1;1H\e[2J";
+  std::cout << "-------------------------------------------------------" << std::endl;
+  std::cout << "CPU Cores: " << sample.cpu_cnt << std::endl;
+  std::cout << "-------------------------------------------------------" << std::endl;
+  std::cout << std::left << "CPU ";
+  std::cout << std::setw(13) << std::right << "Busy";
+  std::cout << std::setw(11) << std::right << "Nice";
+  std::cout << std::setw(12) << std::right << "System";
+  std::cout << std::setw(12) << std::right << "Idle" << std::endl;
+  std::cout << "=======================================================" << std::endl;
+  //
+  //  Display the CPUs percentage of execution time.
+  //
+  for (uint32_t i = 0; i < sample.cpu_cnt; i++)
+  {
+    //
+    //  If the number of CPUs is more than 9, then the width of the
+    //  second column is reduced to mantain the same distance between columns.
+    //
+    if (i == 10 || i == 100 || i == 1000)
+    {
+      fixed_width--;
+    }
+    std::cout << std::left << "CPU" << i;
+    std::cout << std::setprecision(1) << std::fixed;
+    std::cout << std::setw(fixed_width) << std::right << cpu[i].get_cpu_busy_pct() << "%";
+    std::cout << std::setw(10) << std::right << cpu[i].get_cpu_nice_pct() << "%";
+    std::cout << std::setw(11) << std::right << cpu[i].get_cpu_system_pct() << "%";
+    std::cout << std::setw(11) << std::right << cpu[i].get_cpu_idle_pct() << "%" << std::endl;
+  }
+  std::cout << "-------------------------------------------------------" << std::endl;
+  //
+  //  Some machines do not provide the information about page and swap within the file,
+  //  so the float precision is changed to display only two decimals instead of six.
+  //
+  if (system.get_page_ratio() == 0)
+  {
+    fixed_precision = 1;
+  }
   //
-  //  Counters for the number of lines
-  //  and CPUs in the file.
+  //  Display the general system information.
   //
-  uint8_t line_cnt = 0;
-  uint8_t cpu_cnt = 0;
+  std::cout << std::setprecision(fixed_precision) << std::fixed;
+  std::cout << std::left << "Page in/out ratio: " << system.get_page_ratio() << std::endl;
+  std::cout << "Swap in/out ratio: " << system.get_swap_ratio() << std::endl;
+  std::cout << "Interrupts serviced: " << system.get_intr_serviced() << std::endl;
+  std::cout << "Context switch count: " << system.get_ctxt_switch_count() << std::endl;
+  std::cout << "-------------------------------------------------------" << std::endl;
+
+  uint64_t end = PROCSTAT_TICKS();
+  PROCSTAT_RECORD(procstat::Stage::Render, start, end);
 
   //
-  //  Open the file in read mode.
+  //  Display the self statistics, which are not
+  //  part of the render stage.
   //
-  fs.open("/proc/stat", std::ifstream::in);
+  if (options->self_stats)
+  {
+    procstat::profiler.print_panel(std::cout);
+  }
+}
+
+//*****************************************************************************
+//
+//  This function appends the self statistics to the file given in the
+//  options, at most once per second whatever the sampling period is.
+//
+//*****************************************************************************
+static void export_self_stats(const procstat::Sample &sample, void* context)
+{
+  Options* options = static_cast<Options*>(context);
+
+  if (sample.timestamp - options->self_stats_time >= 1000000000)
+  {
+    procstat::profiler.print_json(options->self_stats_file);
+    options->self_stats_time = sample.timestamp;
+  }
+}
+
+//*****************************************************************************
+//
+//  Main Function.
+//
+//*****************************************************************************
+int main(int argc, char const *argv[])
+{
+  Options options;
 
   //
-  //  If the file is open proceed, if not,
-  //  display an error message and exit the program.
+  //  Parse the command line options.
   //
-  if (fs.is_open())
+  for (int i = 1; i < argc; i++)
   {
-    //
-    //  Ignore the first line.
-    //
-    getline(fs, line);
+    if (strcmp(argv[i], "--interval") == 0 && (i + 1) < argc)
+    {
+      options.interval_ms = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
 
-    //
-    //  Read the file line by line.
-    //
-    while (getline(fs, line))
-    {
-      //
-      //  Parse each line an get the label.
-      //
-      parser.parse_string(line);
-      label = parser.get_label();
-
-      //
-      //  If the previous label was a CPU,
-      //  then increase the CPU counter.
-      //
-      if (label == procstat::Label::Cpu)
+      if (options.interval_ms == 0)
+      {
+        std::cerr << "Error: The interval must be at least 1 ms." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (strcmp(argv[i], "--adaptive") == 0 && (i + 1) < argc)
+    {
+      char* end = nullptr;
+
+      options.adaptive = true;
+      options.adaptive_config.min_interval_ms = static_cast<uint32_t>(strtoul(argv[++i], &end, 10));
+      options.adaptive_config.max_interval_ms = (*end == ',') ?
+        static_cast<uint32_t>(strtoul(end + 1, nullptr, 10)) : 0;
+
+      if (options.adaptive_config.min_interval_ms == 0 ||
+          options.adaptive_config.max_interval_ms < options.adaptive_config.min_interval_ms)
+      {
+        std::cerr << "Error: The adaptive bounds must be MIN,MAX with 0 < MIN <= MAX." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (strcmp(argv[i], "--format") == 0 && (i + 1) < argc)
+    {
+      options.export_enabled = true;
+      i++;
+
+      if (strcmp(argv[i], "csv") == 0)
+      {
+        options.export_format = procstat::Format::Csv;
+      }
+      else if (strcmp(argv[i], "json") == 0)
+      {
+        options.export_format = procstat::Format::Json;
+      }
+      else
+      {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (strcmp(argv[i], "--heatmap") == 0)
+    {
+      options.heatmap = true;
+    }
+    else if (strcmp(argv[i], "--self-stats") == 0)
+    {
+      options.self_stats = true;
+    }
+    else if (strcmp(argv[i], "--self-stats-file") == 0 && (i + 1) < argc)
+    {
+      options.self_stats_file.open(argv[++i], std::ofstream::out | std::ofstream::app);
+
+      if (!options.self_stats_file.is_open())
+      {
+        std::cerr << "Error: The self statistics file cannot be open." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (strcmp(argv[i], "--rules") == 0 && (i + 1) < argc)
+    {
+      options.rules_path = argv[++i];
+    }
+    else if (strcmp(argv[i], "--events") == 0 && (i + 1) < argc)
+    {
+      options.events_file.open(argv[++i], std::ofstream::out | std::ofstream::app);
+
+      if (!options.events_file.is_open())
+      {
+        std::cerr << "Error: The events file cannot be open." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (strcmp(argv[i], "--parse-threads") == 0 && (i + 1) < argc)
+    {
+      options.parse_threads = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+
+      if (options.parse_threads == 0)
+      {
+        std::cerr << "Error: The number of parse threads must be at least 1." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (strcmp(argv[i], "--capture") == 0 && (i + 1) < argc)
+    {
+      options.capture_fd = open(argv[++i], O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+      if (options.capture_fd < 0)
+      {
+        std::cerr << "Error: The capture file cannot be open." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (strcmp(argv[i], "--record") == 0 && (i + 1) < argc)
+    {
+      options.record_path = argv[++i];
+    }
+    else if (strcmp(argv[i], "--daemon") == 0)
+    {
+      options.daemon = true;
+    }
+    else if (strcmp(argv[i], "--pin") == 0 && (i + 1) < argc)
+    {
+      char* end = nullptr;
+
+      options.pin_cpu = static_cast<int32_t>(strtol(argv[++i], &end, 10));
+
+      if (*argv[i] == '\0' || *end != '\0' || options.pin_cpu < 0)
+      {
+        std::cerr << "Error: The CPU to pin the monitor to is not valid." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (strcmp(argv[i], "--nice") == 0 && (i + 1) < argc)
+    {
+      char* end = nullptr;
+
+      options.nice_set = true;
+      options.nice = static_cast<int32_t>(strtol(argv[++i], &end, 10));
+
+      if (*argv[i] == '\0' || *end != '\0' || options.nice < -20 || options.nice > 19)
+      {
+        std::cerr << "Error: The nice level must be between -20 and 19." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (strcmp(argv[i], "--budget") == 0 && (i + 1) < argc)
+    {
+      options.budget_pct = static_cast<float>(strtod(argv[++i], nullptr));
+
+      if (!(options.budget_pct > 0 && options.budget_pct <= 100))
       {
-        cpu_cnt++;
+        std::cerr << "Error: The CPU budget must be over 0 and at most 100%." << std::endl;
+        exit(EXIT_FAILURE);
       }
+    }
+    else
+    {
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
 
-      line_cnt++;
+  if (options.heatmap && options.self_stats)
+  {
+    std::cerr << "Error: The self statistics panel is not displayed with --heatmap, use --self-stats-file." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  //
+  //  The daemon has no display, so it needs somewhere to write to.
+  //
+  if (options.daemon)
+  {
+    if (options.heatmap || options.self_stats)
+    {
+      std::cerr << "Error: --daemon has no display, it cannot be used with --heatmap or --self-stats." << std::endl;
+      exit(EXIT_FAILURE);
     }
 
-    fs.close();
+    if (!options.export_enabled && !options.rules_path && options.capture_fd < 0 &&
+        !options.record_path && !options.self_stats_file.is_open())
+    {
+      std::cerr << "Error: --daemon needs --format, --rules, --capture, --record or --self-stats-file." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    if (options.budget_pct == 0)
+    {
+      options.budget_pct = 1;
+    }
   }
-  else
+
+#if !PROCSTAT_SELF_STATS
+  if (options.self_stats || options.self_stats_file.is_open())
   {
-    std::cerr << "Error: The file cannot be open." << std::endl;
-		exit(EXIT_FAILURE);
+    std::cerr << "Error: Built without self statistics (PROCSTAT_SELF_STATS=0)." << std::endl;
+    exit(EXIT_FAILURE);
   }
+#endif
 
   //
-  //  New array of Cpu objects based on the number
-  //  of CPUs previously counted in the file.
+  //  Sampler object to read the file every period
+  //  (0.5 seconds by default).
+  //
+  procstat::Sampler sampler(options.interval_ms);
+
   //
-  procstat::Cpu* cpu = new procstat::Cpu[cpu_cnt];
+  //  The scheduling settings are applied before any parse thread
+  //  is created, so every thread inherits them.
+  //
+  procstat::Daemon daemon(sampler);
+
+  if ((options.pin_cpu >= 0 && !daemon.set_cpu(static_cast<uint32_t>(options.pin_cpu))) ||
+      (options.nice_set && !daemon.set_nice(options.nice)) ||
+      (options.daemon && !options.nice_set && !daemon.set_idle()))
+  {
+    std::cerr << "Error: " << daemon.get_error() << std::endl;
+    exit(EXIT_FAILURE);
+  }
 
   //
-  //  System object to manage general system information
-  //  (page, swap, intr, ctxt, btime).
+  //  The default number of parse threads is the number of CPUs
+  //  the monitor may run on, so it is set after the pinning (a
+  //  single CPU parses on the calling thread only).
   //
-  procstat::System system;
+  sampler.set_parse_threads(options.parse_threads);
 
   //
-  //  The infinite loop does the following steps until CTL + C is pressed:
-  //  Open the file, parse the lines, store data on the corresponding object,
-  //  and display the results.
+  //  If the file is open proceed, if not,
+  //  display an error message and exit the program.
   //
-  while(1)
+  if (!sampler.open())
   {
-    //
-    //  Open the file in read mode.
-    //
-    fs.open("/proc/stat", std::ifstream::in);
+    std::cerr << "Error: The file cannot be open." << std::endl;
+    exit(EXIT_FAILURE);
+  }
 
-    //
-    //  If the file did not open, then display
-    //  an error message and exit the program.
-    //
-    if (!fs.is_open())
+  if (options.adaptive)
+  {
+    sampler.set_adaptive(options.adaptive_config);
+  }
+
+  //
+  //  Rule engine, compiled once for the number of CPUs found. It is
+  //  subscribed before the table, so the events of a sample are
+  //  written before the sample is displayed.
+  //
+  procstat::RuleEngine rules;
+
+  if (options.rules_path)
+  {
+    if (!rules.load(options.rules_path, sampler.get_cpu_count()))
     {
-      std::cerr << "Error: The file cannot be open." << std::endl;
+      std::cerr << "Error: " << options.rules_path << " " << rules.get_error() << std::endl;
       exit(EXIT_FAILURE);
     }
 
-    //
-    //  Ignore the first line.
-    //
-    getline(fs, line);
+    if (options.events_file.is_open())
+    {
+      rules.set_output(&options.events_file);
+    }
+    else if (options.export_enabled)
+    {
+      rules.set_output(&std::cerr);
+    }
+    else
+    {
+      rules.set_output(&std::cout);
+    }
 
-    //
-    //  Loop through the remaining lines.
-    //
-    for (uint8_t i = 0; i < line_cnt; i++)
-    {
-      //
-      //  Read a new line, parse the line,
-      //  and get its label and data.
-      //
-      getline(fs, line);
-      parser.parse_string(line);
-      label = parser.get_label();
-      data = parser.get_data();
-
-      //
-      //  Set the data into the corresponding object.
-      //
-      switch (label)
-      {
-        //
-        //  The CPUs come always first in the file, so the index of the
-        //  for loop can be used as index for the array of Cpu objects.
-        //
-        case procstat::Label::Cpu:
-          cpu[i].set_data(data);
-          break;
-
-        case procstat::Label::Page:
-          system.set_page_data(data);
-          break;
-
-        case procstat::Label::Swap:
-          system.set_swap_data(data);
-          break;
-
-        case procstat::Label::Intr:
-          system.set_intr_data(data);
-          break;
-
-        case procstat::Label::Ctxt:
-          system.set_ctxt_data(data);
-          break;
-
-        case procstat::Label::Btime:
-          system.set_btime_data(data);
-          break;
-
-        default:
-          break;
-      }
+    sampler.subscribe(procstat::RuleEngine::on_sample, &rules);
+  }
+
+  //
+  //  A closed pipe (e.g. the output piped to head) must not kill
+  //  the monitor: the writes fail with EPIPE instead, and the
+  //  event loop reports it and exits.
+  //
+  signal(SIGPIPE, SIG_IGN);
+
+  //
+  //  The samples are either exported to stdout, or displayed
+  //  as a heatmap or a table, or not displayed by the daemon.
+  //
+  procstat::Exporter exporter(options.export_format, STDOUT_FILENO);
+  procstat::Heatmap heatmap(STDOUT_FILENO);
+
+  if (options.export_enabled)
+  {
+    exporter.set_cpu_count(sampler.get_cpu_count());
+    sampler.subscribe(procstat::Exporter::on_sample, &exporter);
+  }
+  else if (options.heatmap)
+  {
+    heatmap.set_cpu_count(sampler.get_cpu_count());
+    sampler.subscribe(procstat::Heatmap::on_sample, &heatmap);
+  }
+  else if (!options.daemon)
+  {
+    sampler.subscribe(render_table, &options);
+  }
+
+  if (options.self_stats_file.is_open())
+  {
+    sampler.subscribe(export_self_stats, &options);
+  }
+
+  //
+  //  The raw snapshots are captured as read, whatever the output.
+  //
+  procstat::CaptureWriter capture(options.capture_fd);
+
+  if (options.capture_fd >= 0)
+  {
+    sampler.subscribe(procstat::CaptureWriter::on_sample, &capture);
+  }
+
+  //
+  //  The busy percentages are recorded in a store, which
+  //  writes its last block when destroyed.
+  //
+  procstat::StoreWriter store;
+
+  if (options.record_path)
+  {
+    if (!store.open(options.record_path, sampler.get_cpu_count()))
+    {
+      std::cerr << "Error: " << options.record_path << " " << store.get_error() << std::endl;
+      exit(EXIT_FAILURE);
     }
 
-    //
-    //  Default values for the output format.
-    //
-    uint8_t fixed_precision = 6;
-    uint8_t fixed_width = 12;
+    sampler.subscribe(procstat::StoreWriter::on_sample, &store);
+  }
 
-    //
-    //  Clean the previous screen and print the new results.
-    //
-    std::cout << "\e[1;1H\e[2J";
-    std::cout << "-------------------------------------------------------" << std::endl;
-    std::cout << "CPU Cores: " << unsigned(cpu_cnt) << std::endl;
-    std::cout << "-------------------------------------------------------" << std::endl;
-    std::cout << std::left << "CPU ";
-    std::cout << std::setw(13) << std::right << "Busy";
-    std::cout << std::setw(11) << std::right << "Nice";
-    std::cout << std::setw(12) << std::right << "System";
-    std::cout << std::setw(12) << std::right << "Idle" << std::endl;
-    std::cout << "=======================================================" << std::endl;
-    //
-    //  Display the CPUs percentage of execution time.
-    //
-    for (uint8_t i = 0; i < cpu_cnt; i++)
+  //
+  //  The budget is checked after the other subscribers,
+  //  so their cost is part of the sample being measured.
+  //
+  if (options.budget_pct > 0)
+  {
+    daemon.set_budget(options.budget_pct);
+    sampler.subscribe(procstat::Daemon::on_sample, &daemon);
+  }
+
+  //
+  //  The daemon takes its first sample right away, so every buffer
+  //  is allocated at its working size and the parse worker threads
+  //  are started, and then locks its memory.
+  //
+  if (options.daemon)
+  {
+    if (!sampler.sample())
     {
-      //
-      //  If the number of CPUs is more than 9, then the width of the
-      //  second column is reduced to mantain the same distance between columns.
-      //
-      if (i == 10)
-      {
-        fixed_width--;
-      }
-      std::cout << std::left << "CPU" << unsigned(i);
-      std::cout << std::setprecision(1) << std::fixed;
-      std::cout << std::setw(fixed_width) << std::right << cpu[i].get_cpu_busy_pct() << "%";
-      std::cout << std::setw(10) << std::right << cpu[i].get_cpu_nice_pct() << "%";
-      std::cout << std::setw(11) << std::right << cpu[i].get_cpu_system_pct() << "%";
-      std::cout << std::setw(11) << std::right << cpu[i].get_cpu_idle_pct() << "%" << std::endl;
-    }
-    std::cout << "-------------------------------------------------------" << std::endl;
-    //
-    //  Some machines do not provide the information about page and swap within the file,
-    //  so the float precision is changed to display only two decimals instead of six.
-    //
-    if (system.get_page_ratio() == 0)
+      std::cerr << "Error: The file cannot be read." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    if (!daemon.lock_memory())
     {
-      fixed_precision = 1;
+      std::cerr << "Error: " << daemon.get_error() << std::endl;
+      exit(EXIT_FAILURE);
     }
-    //
-    //  Display the general system information.
-    //
-    std::cout << std::setprecision(fixed_precision) << std::fixed;
-    std::cout << std::left << "Page in/out ratio: " << system.get_page_ratio() << std::endl;
-    std::cout << "Swap in/out ratio: " << system.get_swap_ratio() << std::endl;
-    std::cout << "Interrupts serviced: " << system.get_intr_serviced() << std::endl;
-    std::cout << "Context switch count: " << system.get_ctxt_switch_count() << std::endl;
-    std::cout << "-------------------------------------------------------" << std::endl;
+  }
 
-    //
-    //  Delay the program execution for 0.5 seconds
-    //  and then close the file.
-    //
-    usleep(500000);
-    fs.close();
+  //
+  //  CTL + C and termination requests are received through a signal
+  //  file descriptor, so the event loop can end and the exported
+  //  samples still held in the buffer are written. The heatmap also
+  //  receives the terminal size changes, to lay the cells out again.
+  //
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+
+  if (options.heatmap)
+  {
+    sigaddset(&signals, SIGWINCH);
   }
 
+  sigprocmask(SIG_BLOCK, &signals, nullptr);
+  int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+
   //
-  //  If the file is still open, close it.
+  //  Register the sampler timer and the signals in the event loop.
+  //  Other file descriptors can be added to the same epoll instance.
   //
-  if (fs.is_open())
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = sampler.get_fd();
+
+  if (epoll_fd < 0 || signal_fd < 0 ||
+      epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sampler.get_fd(), &event) < 0)
   {
-    fs.close();
+    std::cerr << "Error: The event loop cannot be created." << std::endl;
+    exit(EXIT_FAILURE);
   }
 
+  event.data.fd = signal_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event);
+
   //
-  //  Free the memory previously allocated
-  //  for the array of Cpu objects.
+  //  The event loop runs until CTL + C is pressed. On every timer
+  //  expiration the sampler reads the file, stores the data on the
+  //  corresponding objects and notifies the subscribers.
   //
-  delete [] cpu;
+  while (1)
+  {
+    if (epoll_wait(epoll_fd, &event, 1, -1) <= 0)
+    {
+      continue;
+    }
+
+    if (event.data.fd == signal_fd)
+    {
+      struct signalfd_siginfo info;
+
+      if (read(signal_fd, &info, sizeof(info)) == sizeof(info) && info.ssi_signo == SIGWINCH)
+      {
+        heatmap.invalidate();
+        continue;
+      }
+      break;
+    }
+
+    if (event.data.fd == sampler.get_fd() && !sampler.handle_event())
+    {
+      std::cerr << "Error: The file cannot be read." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    if (exporter.has_failed() || capture.has_failed() || store.has_failed())
+    {
+      std::cerr << "Error: The samples cannot be written." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    if (heatmap.has_failed())
+    {
+      std::cerr << "Error: The heatmap cannot be displayed." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  close(epoll_fd);
+  close(signal_fd);
+
+  if (options.capture_fd >= 0)
+  {
+    close(options.capture_fd);
+  }
 
   return 0;
 }
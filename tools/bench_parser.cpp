@@ -0,0 +1,271 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     bench_parser.cpp
+//
+//*****************************************************************************
+//
+//  Standard input/output streams library.
+//
+#include <iostream>
+//
+//  Header providing parametric manipulators.
+//
+#include <iomanip>
+//
+//  Standard string class.
+//
+#include <string>
+//
+//  C string handling functions.
+//
+#include <cstring>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//  C standard general utilities library.
+//
+#include <cstdlib>
+//
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Standard algorithms (sort).
+//
+#include <algorithm>
+//
+//  Time measurement library.
+//
+#include <chrono>
+//
+//  Standard thread class (hardware concurrency).
+//
+#include <thread>
+//
+//  Pseudo-random number generators.
+//
+#include <random>
+//
+//  CPU class.
+//
+#include "../classes/cpu.h"
+//
+//  System class.
+//
+#include "../classes/system.h"
+//
+//  Parser class.
+//
+#include "../classes/parser.h"
+//
+//  Chunk parser class.
+//
+#include "../classes/chunk_parser.h"
+
+//
+//  Number of fields of the interrupts line, about what
+//  a large host with many devices and queues reports.
+//
+static const uint32_t INTR_FIELDS = 2048;
+
+//*****************************************************************************
+//
+//  This function appends a line made of a label and counters to the text.
+//
+//*****************************************************************************
+static void append_line(std::string &text, const std::string &label, const std::vector<uint64_t> &values)
+{
+  text += label;
+
+  for (uint64_t value : values)
+  {
+    text += ' ';
+    text += std::to_string(value);
+  }
+  text += '\n';
+}
+
+//*****************************************************************************
+//
+//  This function generates a "/proc/stat" snapshot of a host with the given
+//  number of CPUs, shaped as the kernel writes it. The counters are taken
+//  from the random generator, and the ones of the CPU lines are advanced by
+//  step ticks, so two snapshots from the same seed and different steps
+//  give non-zero intervals.
+//
+//*****************************************************************************
+static std::string generate_snapshot(uint32_t cpu_cnt, uint64_t seed, uint64_t step)
+{
+  std::mt19937_64 random(seed);
+  std::vector<uint64_t> values(10);
+  std::string text;
+
+  text = "cpu ";
+  append_line(text, "", {1000000 + step, 2000, 300000 + step, 90000000 + step, 4000, 0, 5000, 0, 0, 0});
+
+  for (uint32_t i = 0; i < cpu_cnt; i++)
+  {
+    for (uint64_t &value : values)
+    {
+      value = random() % 100000000 + step * (random() % 4);
+    }
+
+    values[8] = 0;
+    values[9] = 0;
+    append_line(text, "cpu" + std::to_string(i), values);
+  }
+
+  values.assign(INTR_FIELDS, 0);
+
+  for (uint64_t &value : values)
+  {
+    value = (random() % 4 == 0) ? random() % 10000000 : 0;
+  }
+
+  append_line(text, "intr", values);
+  append_line(text, "ctxt", {987654321 + step});
+  append_line(text, "btime", {1700000000});
+  append_line(text, "processes", {1234567});
+  append_line(text, "procs_running", {3});
+  append_line(text, "procs_blocked", {0});
+  append_line(text, "softirq", {123456, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10});
+
+  return text;
+}
+
+//*****************************************************************************
+//
+//  This function parses the snapshots alternately, the Cpu objects being
+//  emptied before every parse as the sampler does, and returns the time of
+//  every parse in microseconds, sorted.
+//
+//*****************************************************************************
+static std::vector<double> run(procstat::ChunkParser &parser, const std::string* snapshots,
+                               uint32_t cpu_cnt, uint32_t iterations)
+{
+  std::vector<procstat::Cpu> cpu(cpu_cnt);
+  procstat::System system;
+  std::vector<double> times;
+
+  times.reserve(iterations);
+
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    const std::string &snapshot = snapshots[i % 2];
+    size_t begin = snapshot.find('\n') + 1;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (procstat::Cpu &core : cpu)
+    {
+      core.clear_interval();
+    }
+
+    parser.parse(&snapshot[begin], snapshot.length() - begin, cpu.data(), cpu_cnt, system);
+
+    auto end = std::chrono::steady_clock::now();
+    times.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+  }
+
+  std::sort(times.begin(), times.end());
+
+  return times;
+}
+
+//*****************************************************************************
+//
+//  This function displays the command line usage.
+//
+//*****************************************************************************
+static void print_usage(const char* name)
+{
+  std::cerr << "Usage: " << name << " [--cpus N] [--iterations N] [--threads N]" << std::endl;
+  std::cerr << "  Times the parse of a generated \"/proc/stat\" snapshot of N CPUs" << std::endl;
+  std::cerr << "  (default 4096) on the calling thread and split in chunks on up to" << std::endl;
+  std::cerr << "  N threads (default the number of hardware threads)." << std::endl;
+}
+
+//*****************************************************************************
+//
+//  Main function.
+//
+//*****************************************************************************
+int main(int argc, char* argv[])
+{
+  uint32_t cpu_cnt = 4096;
+  uint32_t iterations = 1000;
+  uint32_t thread_cnt = std::thread::hardware_concurrency();
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--cpus") == 0 && (i + 1) < argc)
+    {
+      cpu_cnt = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+    }
+    else if (strcmp(argv[i], "--iterations") == 0 && (i + 1) < argc)
+    {
+      iterations = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+    }
+    else if (strcmp(argv[i], "--threads") == 0 && (i + 1) < argc)
+    {
+      thread_cnt = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+    }
+    else
+    {
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (cpu_cnt == 0 || iterations == 0)
+  {
+    std::cerr << "Error: The CPUs and iterations must be at least 1." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  thread_cnt = (thread_cnt == 0) ? 1 : thread_cnt;
+
+  //
+  //  Two snapshots of the same host one step apart,
+  //  parsed alternately so every interval is new.
+  //
+  const std::string snapshots[2] = {generate_snapshot(cpu_cnt, 1, 0), generate_snapshot(cpu_cnt, 1, 100)};
+
+  std::cout << "CPUs: " << cpu_cnt << ", snapshot: " << snapshots[0].length() / 1024 << " KiB, iterations: "
+            << iterations << std::endl;
+  std::cout << std::left << std::setw(10) << "Threads";
+  std::cout << std::setw(10) << std::right << "Chunks";
+  std::cout << std::setw(12) << std::right << "p50 (us)";
+  std::cout << std::setw(12) << std::right << "p99 (us)";
+  std::cout << std::setw(12) << std::right << "ns/CPU";
+  std::cout << std::setw(10) << std::right << "MB/s" << std::endl;
+
+  std::vector<uint32_t> counts = {1};
+
+  if (thread_cnt > 1)
+  {
+    counts.push_back(thread_cnt);
+  }
+
+  for (uint32_t count : counts)
+  {
+    procstat::ChunkParser parser(count);
+    std::vector<double> times = run(parser, snapshots, cpu_cnt, iterations);
+    double p50 = times[times.size() / 2];
+    double p99 = times[std::min<size_t>(times.size() - 1, times.size() * 99 / 100)];
+
+    std::cout << std::setprecision(1) << std::fixed;
+    std::cout << std::left << std::setw(10) << count;
+    std::cout << std::setw(10) << std::right << parser.get_chunk_count(snapshots[0].length());
+    std::cout << std::setw(12) << std::right << p50;
+    std::cout << std::setw(12) << std::right << p99;
+    std::cout << std::setw(12) << std::right << (p50 * 1000 / cpu_cnt);
+    std::cout << std::setw(10) << std::right << (snapshots[0].length() / p50) << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,846 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     fuzz_parser.cpp
+//
+//*****************************************************************************
+//
+//  Standard input/output streams library.
+//
+#include <iostream>
+//
+//  Input/output stream class to operate on files.
+//
+#include <fstream>
+//
+//  Stream class to operate on strings.
+//
+#include <sstream>
+//
+//  Standard string class.
+//
+#include <string>
+//
+//  C string handling functions.
+//
+#include <cstring>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//  C standard general utilities library.
+//
+#include <cstdlib>
+//
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Standard set container.
+//
+#include <set>
+//
+//  Pseudo-random number generators.
+//
+#include <random>
+//
+//  CPU class.
+//
+#include "../classes/cpu.h"
+//
+//  System class.
+//
+#include "../classes/system.h"
+//
+//  Parser class.
+//
+#include "../classes/parser.h"
+//
+//  Chunk parser class.
+//
+#include "../classes/chunk_parser.h"
+
+//
+//  Labels matched by the parser, by their first three characters,
+//  in the order of the Label enumeration.
+//
+static const char* LABELS[] = {"cpu", "pag", "swa", "int", "ctx", "bti"};
+static const uint8_t LABEL_COUNT = 6;
+
+//
+//  Highest number of Cpu objects allocated for a snapshot. CPU lines
+//  with a higher index must be ignored by every parser alike.
+//
+static const uint32_t MAX_CPUS = 65536;
+
+//*****************************************************************************
+//
+//  Line structure.
+//  Expected result of parsing a line, as given by the reference parser.
+//
+//*****************************************************************************
+struct Line
+{
+  procstat::Label label;
+  int32_t cpu_index;
+  uint64_t data[procstat::Parser::DATA_COUNT];
+};
+
+//*****************************************************************************
+//
+//  ChunkParser configuration: maximum threads and chunk size. The small
+//  chunk sizes split even the smallest inputs, so every line boundary is
+//  tried as a chunk boundary.
+//
+//*****************************************************************************
+struct ChunkConfig
+{
+  uint32_t thread_cnt;
+  size_t chunk_size;
+};
+
+static const ChunkConfig CHUNK_CONFIGS[] = {{1, 65536}, {2, 16}, {4, 64}, {3, 1}};
+
+//*****************************************************************************
+//
+//  This function tells whether a character is a decimal digit, whatever
+//  the locale and the sign of char.
+//
+//*****************************************************************************
+static bool is_digit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+//*****************************************************************************
+//
+//  This function converts a string of decimal digits into a number. If it
+//  is larger than the maximum, the maximum is returned and saturated set.
+//
+//*****************************************************************************
+static uint64_t to_number(const std::string &digits, uint64_t max, bool &saturated)
+{
+  size_t first = digits.find_first_not_of('0');
+
+  saturated = false;
+
+  if (first == std::string::npos)
+  {
+    return 0;
+  }
+
+  std::string number = digits.substr(first);
+  std::string max_text = std::to_string(max);
+
+  if (number.length() > max_text.length() ||
+      (number.length() == max_text.length() && number > max_text))
+  {
+    saturated = true;
+    return max;
+  }
+
+  return std::stoull(number);
+}
+
+//*****************************************************************************
+//
+//  This function is the reference parser. It is written for clarity rather
+//  than speed, and defines what every parser must return for a line:
+//  - The label is the text before the first space, matched on its first
+//    three characters. Any other label is Unknown.
+//  - The cpu index is the number that follows "cpu", saturated to
+//    INT32_MAX, or -1 if "cpu" is not followed by a digit.
+//  - The data are the first DATA_COUNT fields separated by one or more
+//    spaces. A field starting with anything but a digit ends the data,
+//    and so does a field with trailing characters after its digits (which
+//    are kept). Numbers too large for 64 bits are saturated and end the
+//    data. The missing values are zero.
+//
+//*****************************************************************************
+static void reference_parse(const std::string &text, Line &line)
+{
+  bool saturated = false;
+
+  line.label = procstat::Label::Unknown;
+  line.cpu_index = -1;
+  memset(line.data, 0, sizeof(line.data));
+
+  size_t label_end = text.find(' ');
+  label_end = (label_end == std::string::npos) ? text.length() : label_end;
+
+  std::string label = text.substr(0, label_end);
+
+  for (uint8_t i = 0; i < LABEL_COUNT && label.length() >= 3; i++)
+  {
+    if (label.compare(0, 3, LABELS[i]) == 0)
+    {
+      line.label = static_cast<procstat::Label>(i);
+    }
+  }
+
+  if (line.label == procstat::Label::Cpu && label.length() > 3 && is_digit(label[3]))
+  {
+    size_t digits = 3;
+
+    while (digits < label.length() && is_digit(label[digits]))
+    {
+      digits++;
+    }
+
+    uint64_t index = to_number(label.substr(3, digits - 3), INT32_MAX, saturated);
+    line.cpu_index = static_cast<int32_t>(index);
+  }
+
+  size_t pos = label_end;
+
+  for (uint8_t i = 0; i < procstat::Parser::DATA_COUNT; i++)
+  {
+    size_t start = text.find_first_not_of(' ', pos);
+
+    if (start == std::string::npos || !is_digit(text[start]))
+    {
+      break;
+    }
+
+    size_t end = text.find(' ', start);
+    end = (end == std::string::npos) ? text.length() : end;
+
+    std::string field = text.substr(start, end - start);
+    size_t digits = 0;
+
+    while (digits < field.length() && is_digit(field[digits]))
+    {
+      digits++;
+    }
+
+    line.data[i] = to_number(field.substr(0, digits), UINT64_MAX, saturated);
+
+    if (saturated || digits < field.length())
+    {
+      break;
+    }
+
+    pos = end;
+  }
+}
+
+//*****************************************************************************
+//
+//  This function escapes a line to be displayed, cutting it if too long.
+//
+//*****************************************************************************
+static std::string escape(const std::string &text)
+{
+  std::ostringstream ss;
+  size_t length = (text.length() > 160) ? 160 : text.length();
+
+  for (size_t i = 0; i < length; i++)
+  {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+
+    if (c == '"' || c == '\\')
+    {
+      ss << '\\' << text[i];
+    }
+    else if (c >= 0x20 && c < 0x7F)
+    {
+      ss << text[i];
+    }
+    else
+    {
+      const char* hex = "0123456789abcdef";
+      ss << "\\x" << hex[c >> 4] << hex[c & 0x0F];
+    }
+  }
+
+  if (length < text.length())
+  {
+    ss << "... (" << text.length() << " bytes)";
+  }
+
+  return ss.str();
+}
+
+//*****************************************************************************
+//
+//  This function compares the result of a parser with the reference one,
+//  and describes the difference on the standard error if any.
+//
+//*****************************************************************************
+static bool check_line(const char* name, const std::string &text, const Line &expected,
+                       procstat::Parser &parser)
+{
+  const uint64_t* data = parser.get_data();
+  bool same = (parser.get_label() == expected.label && parser.get_cpu_index() == expected.cpu_index &&
+               memcmp(data, expected.data, sizeof(expected.data)) == 0);
+
+  if (!same)
+  {
+    std::cerr << "Mismatch in " << name << " on line \"" << escape(text) << "\"" << std::endl;
+    std::cerr << "  expected label " << static_cast<int>(expected.label) << " cpu " << expected.cpu_index << " data";
+
+    for (uint8_t i = 0; i < procstat::Parser::DATA_COUNT; i++)
+    {
+      std::cerr << " " << expected.data[i];
+    }
+
+    std::cerr << std::endl << "  got      label " << static_cast<int>(parser.get_label())
+              << " cpu " << parser.get_cpu_index() << " data";
+
+    for (uint8_t i = 0; i < procstat::Parser::DATA_COUNT; i++)
+    {
+      std::cerr << " " << data[i];
+    }
+    std::cerr << std::endl;
+  }
+
+  return same;
+}
+
+//*****************************************************************************
+//
+//  This function splits an input into lines, as the sampler and the chunk
+//  parser do: a last line without new line character counts, but not the
+//  empty text after a last new line character.
+//
+//*****************************************************************************
+static void split_lines(const char* data, size_t size, std::vector<std::string> &lines)
+{
+  size_t begin = 0;
+
+  lines.clear();
+
+  while (begin < size)
+  {
+    const char* end = static_cast<const char*>(memchr(data + begin, '\n', size - begin));
+    size_t length = end ? static_cast<size_t>(end - (data + begin)) : (size - begin);
+
+    lines.emplace_back(data + begin, length);
+    begin += length + 1;
+  }
+}
+
+//*****************************************************************************
+//
+//  This function checks every line of an input with parse_line and
+//  parse_string against the reference parser.
+//
+//*****************************************************************************
+static bool check_lines(const std::vector<std::string> &lines)
+{
+  procstat::Parser parser;
+  Line expected;
+
+  for (const std::string &text : lines)
+  {
+    reference_parse(text, expected);
+
+    parser.parse_line(text.data(), text.data() + text.length());
+
+    if (!check_line("parse_line", text, expected, parser))
+    {
+      return false;
+    }
+
+    parser.parse_string(text);
+
+    if (!check_line("parse_string", text, expected, parser))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//*****************************************************************************
+//
+//  This function checks a whole input with the chunk parser, in several
+//  configurations, against the reference parser applied line by line. The
+//  chunk parser requires every line to appear once, as in "/proc/stat", so
+//  inputs repeating a line are only checked on a single chunk, where the
+//  last line wins.
+//
+//*****************************************************************************
+static bool check_snapshot(const char* data, size_t size, const std::vector<std::string> &lines)
+{
+  std::vector<Line> parsed(lines.size());
+  std::set<int32_t> cpus;
+  std::set<procstat::Label> labels;
+  uint32_t cpu_cnt = 0;
+  bool unique = true;
+
+  for (size_t i = 0; i < lines.size(); i++)
+  {
+    Line &line = parsed[i];
+    reference_parse(lines[i], line);
+
+    if (line.label == procstat::Label::Cpu && line.cpu_index >= 0)
+    {
+      unique &= cpus.insert(line.cpu_index).second;
+
+      if (static_cast<uint32_t>(line.cpu_index) < MAX_CPUS &&
+          static_cast<uint32_t>(line.cpu_index) >= cpu_cnt)
+      {
+        cpu_cnt = line.cpu_index + 1;
+      }
+    }
+    else if (line.label != procstat::Label::Cpu && line.label != procstat::Label::Unknown)
+    {
+      unique &= labels.insert(line.label).second;
+    }
+  }
+
+  //
+  //  Expected objects, set line by line.
+  //
+  std::vector<procstat::Cpu> expected_cpu(cpu_cnt);
+  procstat::System expected_system;
+
+  for (Line &line : parsed)
+  {
+    switch (line.label)
+    {
+      case procstat::Label::Cpu:
+        if (line.cpu_index >= 0 && static_cast<uint32_t>(line.cpu_index) < cpu_cnt)
+        {
+          expected_cpu[line.cpu_index].set_data(line.data);
+        }
+        break;
+
+      case procstat::Label::Page:
+        expected_system.set_page_data(line.data);
+        break;
+
+      case procstat::Label::Swap:
+        expected_system.set_swap_data(line.data);
+        break;
+
+      case procstat::Label::Intr:
+        expected_system.set_intr_data(line.data);
+        break;
+
+      case procstat::Label::Ctxt:
+        expected_system.set_ctxt_data(line.data);
+        break;
+
+      case procstat::Label::Btime:
+        expected_system.set_btime_data(line.data);
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  float expected_ratios[2] = {expected_system.get_page_ratio(), expected_system.get_swap_ratio()};
+
+  for (const ChunkConfig &config : CHUNK_CONFIGS)
+  {
+    procstat::ChunkParser chunk_parser(config.thread_cnt, config.chunk_size);
+
+    if (!unique && chunk_parser.get_chunk_count(size) > 1)
+    {
+      continue;
+    }
+
+    std::vector<procstat::Cpu> cpu(cpu_cnt);
+    procstat::System system;
+    uint32_t line_cnt = chunk_parser.parse(data, size, cpu.data(), cpu_cnt, system);
+    float ratios[2] = {system.get_page_ratio(), system.get_swap_ratio()};
+    std::string error;
+
+    if (line_cnt != lines.size())
+    {
+      error = "parsed " + std::to_string(line_cnt) + " lines instead of " + std::to_string(lines.size());
+    }
+    else if (system.get_intr_count() != expected_system.get_intr_count() ||
+             system.get_ctxt_count() != expected_system.get_ctxt_count() ||
+             memcmp(ratios, expected_ratios, sizeof(ratios)) != 0)
+    {
+      error = "the system lines differ";
+    }
+
+    for (uint32_t i = 0; i < cpu_cnt && error.empty(); i++)
+    {
+      for (uint8_t j = 0; j < static_cast<uint8_t>(procstat::CpuField::Count); j++)
+      {
+        procstat::CpuField field = static_cast<procstat::CpuField>(j);
+
+        if (cpu[i].get_counter(field) != expected_cpu[i].get_counter(field))
+        {
+          error = "CPU" + std::to_string(i) + " field " + std::to_string(j) + " is " +
+                  std::to_string(cpu[i].get_counter(field)) + " instead of " +
+                  std::to_string(expected_cpu[i].get_counter(field));
+          break;
+        }
+      }
+    }
+
+    if (!error.empty())
+    {
+      std::cerr << "Mismatch in ChunkParser(" << config.thread_cnt << ", " << config.chunk_size
+                << ") on " << chunk_parser.get_chunk_count(size) << " chunks: " << error << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//*****************************************************************************
+//
+//  This function checks every parser on an input. Returns false on the
+//  first mismatch, which is described on the standard error.
+//
+//*****************************************************************************
+static bool check_input(const char* data, size_t size)
+{
+  std::vector<std::string> lines;
+
+  split_lines(data, size, lines);
+
+  return check_lines(lines) && check_snapshot(data, size, lines);
+}
+
+#ifdef PROCSTAT_LIBFUZZER
+
+//*****************************************************************************
+//
+//  libFuzzer entry point. A mismatch aborts, so the input is saved.
+//
+//*****************************************************************************
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+  if (!check_input(reinterpret_cast<const char*>(data), size))
+  {
+    abort();
+  }
+
+  return 0;
+}
+
+#else
+
+//*****************************************************************************
+//
+//  This function returns a random counter, most of the time a plausible
+//  one, and otherwise one on the edges of 64 bits or with leading zeros.
+//
+//*****************************************************************************
+static std::string random_number(std::mt19937_64 &random)
+{
+  switch (random() % 16)
+  {
+    case 0:
+      return "0";
+
+    case 1:
+      return std::to_string(UINT64_MAX);
+
+    case 2:
+      return "18446744073709551616";
+
+    case 3:
+      return std::string(21 + random() % 20, '9');
+
+    case 4:
+      return "000" + std::to_string(random() % 1000);
+
+    case 5:
+      return std::to_string(random());
+
+    default:
+      return std::to_string(random() % 100000000);
+  }
+}
+
+//*****************************************************************************
+//
+//  This function appends a line made of a label and a number of values.
+//
+//*****************************************************************************
+static void append_line(std::mt19937_64 &random, std::string &text, const std::string &label,
+                        uint32_t value_cnt)
+{
+  text += label;
+
+  for (uint32_t i = 0; i < value_cnt; i++)
+  {
+    text += ' ';
+    text += random_number(random);
+  }
+
+  text += '\n';
+}
+
+//*****************************************************************************
+//
+//  This function returns a line the kernel never writes: unknown or empty
+//  labels, labels longer than 255 characters, huge or negative CPU indexes,
+//  signs, tabs, carriage returns, null characters and fields glued together.
+//
+//*****************************************************************************
+static std::string random_junk(std::mt19937_64 &random)
+{
+  switch (random() % 14)
+  {
+    case 0:
+      return "";
+
+    case 1:
+      return "cpu";
+
+    case 2:
+      return "c";
+
+    case 3:
+      return "nospaceatall" + random_number(random);
+
+    case 4:
+      return std::string(256 + random() % 300, 'x') + " 1 2 3";
+
+    case 5:
+      return "cpu" + std::string(12 + random() % 20, '7') + " 1 2 3 4";
+
+    case 6:
+      return "cpu-1 1 2 3 4";
+
+    case 7:
+      return "cpu2 -5 +6 7 8";
+
+    case 8:
+      return "cpu3\t1\t2 3 4";
+
+    case 9:
+      return "ctxt 12345\r";
+
+    case 10:
+      return std::string("intr 1") + '\0' + "2 3";
+
+    case 11:
+      return "cpu4 1.5 2 3 4";
+
+    case 12:
+      return "softirq 1 2 3 4 5 6 7 8 9 10";
+
+    default:
+      return "   " + random_number(random) + "  " + random_number(random);
+  }
+}
+
+//*****************************************************************************
+//
+//  This function generates a "/proc/stat" snapshot: from one to thousands
+//  of CPUs with some of them offline, all the system lines and an oversized
+//  interrupts line, and the CPU lines having from none to more than the
+//  usual ten fields. Half of the snapshots are then damaged by truncating
+//  them, changing, inserting or deleting bytes, inserting junk lines, and
+//  repeating lines.
+//
+//*****************************************************************************
+static std::string generate_snapshot(std::mt19937_64 &random)
+{
+  std::string text;
+  uint32_t cpu_cnt = 1 + random() % 8;
+
+  switch (random() % 10)
+  {
+    case 0:
+      cpu_cnt = 1 + random() % 4096;
+      break;
+
+    case 1:
+    case 2:
+      cpu_cnt = 1 + random() % 256;
+      break;
+
+    default:
+      break;
+  }
+
+  text = "cpu ";
+  append_line(random, text, "", 10);
+
+  for (uint32_t i = 0; i < cpu_cnt; i++)
+  {
+    if (random() % 16 == 0)
+    {
+      continue;
+    }
+
+    uint32_t value_cnt = (random() % 8 == 0) ? static_cast<uint32_t>(random() % 13) : 10;
+    append_line(random, text, "cpu" + std::to_string(i), value_cnt);
+  }
+
+  append_line(random, text, "intr", 1 + ((random() % 4 == 0) ? random() % 4000 : random() % 64));
+  append_line(random, text, "ctxt", 1);
+  append_line(random, text, "btime", 1);
+  append_line(random, text, "processes", 1);
+  append_line(random, text, "procs_running", 1);
+  append_line(random, text, "procs_blocked", 1);
+  append_line(random, text, "softirq", 11);
+
+  if (random() % 2)
+  {
+    append_line(random, text, "page", 2);
+    append_line(random, text, "swap", 2);
+  }
+
+  //
+  //  Damage half of the snapshots.
+  //
+  uint32_t damage_cnt = (random() % 2) ? static_cast<uint32_t>(1 + random() % 4) : 0;
+  const char bytes[] = " \t\r\n-+.x09";
+
+  for (uint32_t i = 0; i < damage_cnt && !text.empty(); i++)
+  {
+    size_t pos = random() % text.length();
+
+    switch (random() % 6)
+    {
+      case 0:
+        text.resize(pos);
+        break;
+
+      case 1:
+        text[pos] = (random() % 2) ? bytes[random() % (sizeof(bytes) - 1)] : static_cast<char>(random());
+        break;
+
+      case 2:
+        text.insert(pos, 1, (random() % 2) ? bytes[random() % (sizeof(bytes) - 1)] : static_cast<char>(random()));
+        break;
+
+      case 3:
+        text.erase(pos, 1 + random() % 64);
+        break;
+
+      case 4:
+      {
+        pos = text.rfind('\n', pos);
+        pos = (pos == std::string::npos) ? 0 : pos + 1;
+        text.insert(pos, random_junk(random) + "\n");
+        break;
+      }
+
+      default:
+      {
+        size_t begin = text.rfind('\n', pos);
+        begin = (begin == std::string::npos) ? 0 : begin + 1;
+        size_t end = text.find('\n', pos);
+        end = (end == std::string::npos) ? text.length() : end + 1;
+        std::string line = text.substr(begin, end - begin);
+
+        text.insert(random() % text.length(), (line.back() == '\n') ? line : line + "\n");
+        break;
+      }
+    }
+  }
+
+  return text;
+}
+
+//*****************************************************************************
+//
+//  This function displays the command line usage.
+//
+//*****************************************************************************
+static void print_usage(const char* name)
+{
+  std::cerr << "Usage: " << name << " [--iterations N] [--seed S] [FILE...]" << std::endl;
+  std::cerr << "  Checks every parser against the reference one on N generated snapshots" << std::endl;
+  std::cerr << "  (default 2000), or on the given files (e.g. inputs saved by libFuzzer)." << std::endl;
+}
+
+//*****************************************************************************
+//
+//  Main function.
+//
+//*****************************************************************************
+int main(int argc, char* argv[])
+{
+  uint64_t iterations = 2000;
+  uint64_t seed = std::random_device()();
+  std::vector<const char*> paths;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--iterations") == 0 && (i + 1) < argc)
+    {
+      iterations = strtoull(argv[++i], nullptr, 10);
+    }
+    else if (strcmp(argv[i], "--seed") == 0 && (i + 1) < argc)
+    {
+      seed = strtoull(argv[++i], nullptr, 10);
+    }
+    else if (argv[i][0] != '-')
+    {
+      paths.push_back(argv[i]);
+    }
+    else
+    {
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  //
+  //  Replay the given files.
+  //
+  for (const char* path : paths)
+  {
+    std::ifstream file(path, std::ifstream::binary);
+    std::ostringstream ss;
+
+    if (!file.is_open())
+    {
+      std::cerr << "Error: " << path << " cannot be open." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    ss << file.rdbuf();
+    std::string text = ss.str();
+
+    if (!check_input(text.data(), text.length()))
+    {
+      std::cerr << "Failed on " << path << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (!paths.empty())
+  {
+    std::cout << paths.size() << " files checked." << std::endl;
+    return 0;
+  }
+
+  //
+  //  Every snapshot has its own seed, so a failure
+  //  can be replayed alone.
+  //
+  uint64_t bytes = 0;
+
+  for (uint64_t i = 0; i < iterations; i++)
+  {
+    std::mt19937_64 random(seed + i);
+    std::string text = generate_snapshot(random);
+
+    bytes += text.length();
+
+    if (!check_input(text.data(), text.length()))
+    {
+      std::cerr << "Failed on snapshot " << i << ", replay with --seed " << (seed + i)
+                << " --iterations 1" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  std::cout << iterations << " snapshots (" << (bytes >> 10) << " KiB) checked with seed "
+            << seed << "." << std::endl;
+
+  return 0;
+}
+
+#endif  // PROCSTAT_LIBFUZZER
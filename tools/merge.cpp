@@ -0,0 +1,438 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     merge.cpp
+//
+//*****************************************************************************
+//
+//  Standard input/output streams library.
+//
+#include <iostream>
+//
+//  Standard string class.
+//
+#include <string>
+//
+//  C string handling functions.
+//
+#include <cstring>
+//
+//  Header providing parametric manipulators.
+//
+#include <iomanip>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//  C standard general utilities library.
+//
+#include <cstdlib>
+//
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Smart pointers.
+//
+#include <memory>
+//
+//  Atomic operations library.
+//
+#include <atomic>
+//
+//  Standard thread and mutex classes.
+//
+#include <thread>
+#include <mutex>
+//
+//  CPU class.
+//
+#include "../classes/cpu.h"
+//
+//  System class.
+//
+#include "../classes/system.h"
+//
+//  Parser class.
+//
+#include "../classes/parser.h"
+//
+//  Chunk parser class.
+//
+#include "../classes/chunk_parser.h"
+//
+//  Sampler class.
+//
+#include "../classes/sampler.h"
+//
+//  Capture reader and writer classes.
+//
+#include "../classes/capture.h"
+//
+//  Sketch class.
+//
+#include "../classes/sketch.h"
+
+//
+//  Largest number of grid slots, which bounds the memory used
+//  (about 10 KiB per slot).
+//
+static const uint64_t MAX_SLOTS = 1000000;
+
+//
+//  Number of locks shared by the slots.
+//
+static const uint32_t LOCK_COUNT = 64;
+
+//*****************************************************************************
+//
+//  Distributions of a grid slot.
+//  busy, steal - CPU percentages in tenths, one value per CPU and sample.
+//  intr_rate - interrupts per second, one value per host and sample.
+//
+//*****************************************************************************
+struct Slot
+{
+  procstat::Sketch busy{10};
+  procstat::Sketch steal{10};
+  procstat::Sketch intr_rate{32};
+};
+
+//*****************************************************************************
+//
+//  State shared by the worker threads.
+//  readers - mapped capture files, taken in order by the workers.
+//  next_reader - index of the next capture file to take.
+//  start_ms, grid_ms - start time and period of the grid.
+//  slots - distributions of every grid slot, merged from the workers.
+//  locks - locks of the slots, slot N being protected by lock N % LOCK_COUNT.
+//
+//*****************************************************************************
+struct Merge
+{
+  std::vector<std::unique_ptr<procstat::CaptureReader>> readers;
+  std::atomic<size_t> next_reader{0};
+  uint64_t start_ms = 0;
+  uint32_t grid_ms = 60000;
+  std::vector<Slot> slots;
+  std::vector<std::mutex> locks{LOCK_COUNT};
+};
+
+//*****************************************************************************
+//
+//  This function displays the command line usage.
+//
+//*****************************************************************************
+static void print_usage(const char* name)
+{
+  std::cerr << "Usage: " << name << " [options] CAPTURE..." << std::endl;
+  std::cerr << "  --grid MS                length of the time slots in milliseconds (default 60000)" << std::endl;
+  std::cerr << "  --threads N              number of files read at once (default the number" << std::endl;
+  std::cerr << "                           of hardware threads)" << std::endl;
+}
+
+//*****************************************************************************
+//
+//  This function returns the highest CPU index of a snapshot plus one. The
+//  CPU lines come first in the file, so the scan stops at the first line
+//  that is not one, and only their "cpuN" prefix is read.
+//
+//*****************************************************************************
+static uint32_t count_cpus(const char* data, size_t length)
+{
+  const char* end = data + length;
+  uint32_t cpu_cnt = 0;
+
+  while (end - data > 3 && memcmp(data, "cpu", 3) == 0)
+  {
+    const char* line_end = static_cast<const char*>(memchr(data, '\n', end - data));
+    const char* pos = data + 3;
+    uint32_t index = 0;
+
+    line_end = line_end ? line_end : end;
+
+    if (pos < line_end && *pos >= '0' && *pos <= '9')
+    {
+      while (pos < line_end && *pos >= '0' && *pos <= '9')
+      {
+        index = index * 10 + (*pos++ - '0');
+      }
+
+      cpu_cnt = (index >= cpu_cnt) ? index + 1 : cpu_cnt;
+    }
+    data = line_end + 1;
+  }
+
+  return cpu_cnt;
+}
+
+//*****************************************************************************
+//
+//  This function merges the distributions of a slot built by a worker
+//  into the shared slot, and clears them.
+//
+//*****************************************************************************
+static void flush_slot(Merge &merge, uint64_t slot_idx, Slot &pending)
+{
+  if (pending.intr_rate.get_count() == 0 && pending.busy.get_count() == 0)
+  {
+    return;
+  }
+
+  Slot &slot = merge.slots[slot_idx];
+  std::lock_guard<std::mutex> lock(merge.locks[slot_idx % LOCK_COUNT]);
+
+  slot.busy.merge(pending.busy);
+  slot.steal.merge(pending.steal);
+  slot.intr_rate.merge(pending.intr_rate);
+
+  pending.busy.clear();
+  pending.steal.clear();
+  pending.intr_rate.clear();
+}
+
+//*****************************************************************************
+//
+//  This function streams the records of a capture file through a chunk
+//  parser, so the Cpu and System objects hold the deltas between two
+//  consecutive records. Each interval is added to the slot holding its end
+//  time. The values of the current slot are kept apart and merged into the
+//  shared slot once the file moves to the next one, so the lock is taken
+//  once per slot and file rather than once per record. Records out of order
+//  are skipped, and so are the CPUs missing from a record (offline) or
+//  whose counters did not move (e.g. after a reboot). The Cpu objects are
+//  added when a record holds more CPUs than the previous ones, and the
+//  first interval of the new ones (since boot) is skipped.
+//
+//*****************************************************************************
+static void merge_file(Merge &merge, procstat::CaptureReader &reader)
+{
+  procstat::ChunkParser parser(1);
+  procstat::System system;
+  std::vector<procstat::Cpu> cpu;
+  Slot pending;
+  uint64_t pending_idx = 0;
+  uint64_t last_time = 0;
+  uint64_t last_intr = 0;
+  uint64_t time_ms;
+  const char* data;
+  size_t length;
+
+  while (reader.next(time_ms, data, length))
+  {
+    if (time_ms <= last_time || time_ms < merge.start_ms)
+    {
+      continue;
+    }
+
+    size_t known_cnt = cpu.size();
+    uint32_t cpu_cnt = count_cpus(data, length);
+
+    if (cpu_cnt > known_cnt)
+    {
+      cpu.resize(cpu_cnt);
+    }
+
+    //
+    //  The Cpu objects are reused across records, so the
+    //  ones missing from this record must not keep the
+    //  interval of the previous one.
+    //
+    for (procstat::Cpu &core : cpu)
+    {
+      core.clear_interval();
+    }
+
+    parser.parse(data, length, cpu.data(), static_cast<uint32_t>(cpu.size()), system);
+
+    uint64_t intr = system.get_intr_count();
+    uint64_t slot_idx = (time_ms - merge.start_ms) / merge.grid_ms;
+
+    if (last_time != 0 && slot_idx < merge.slots.size())
+    {
+      if (slot_idx != pending_idx)
+      {
+        flush_slot(merge, pending_idx, pending);
+        pending_idx = slot_idx;
+      }
+
+      for (size_t i = 0; i < known_cnt; i++)
+      {
+        const procstat::Cpu &core = cpu[i];
+
+        if (core.is_online() && core.get_interval_time() > 0)
+        {
+          pending.busy.add(static_cast<uint64_t>(core.get_interval_busy_pct() * 10 + 0.5f));
+          pending.steal.add(static_cast<uint64_t>(core.get_interval_pct(procstat::CpuField::Steal) * 10 + 0.5f));
+        }
+      }
+
+      if (intr >= last_intr)
+      {
+        pending.intr_rate.add((intr - last_intr) * 1000 / (time_ms - last_time));
+      }
+    }
+
+    last_time = time_ms;
+    last_intr = intr;
+  }
+
+  flush_slot(merge, pending_idx, pending);
+}
+
+//*****************************************************************************
+//
+//  This function is run by every worker thread. It takes the capture files
+//  one at a time until all of them are merged.
+//
+//*****************************************************************************
+static void merge_files(Merge* merge)
+{
+  size_t reader_idx;
+
+  while ((reader_idx = merge->next_reader.fetch_add(1)) < merge->readers.size())
+  {
+    merge_file(*merge, *merge->readers[reader_idx]);
+  }
+}
+
+//*****************************************************************************
+//
+//  Main function.
+//
+//*****************************************************************************
+int main(int argc, char* argv[])
+{
+  Merge merge;
+  uint32_t thread_cnt = std::thread::hardware_concurrency();
+  std::vector<const char*> paths;
+
+  //
+  //  Parse the command line options.
+  //
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--grid") == 0 && (i + 1) < argc)
+    {
+      merge.grid_ms = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+
+      if (merge.grid_ms == 0)
+      {
+        std::cerr << "Error: The grid must be at least 1 ms." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    else if (strcmp(argv[i], "--threads") == 0 && (i + 1) < argc)
+    {
+      thread_cnt = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+    }
+    else if (argv[i][0] == '-')
+    {
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+    else
+    {
+      paths.push_back(argv[i]);
+    }
+  }
+
+  if (paths.empty())
+  {
+    print_usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  thread_cnt = (thread_cnt == 0) ? 1 : thread_cnt;
+
+  //
+  //  Map every file and find the time range they cover
+  //  from their first and last records.
+  //
+  uint64_t first_ms = UINT64_MAX;
+  uint64_t last_ms = 0;
+
+  for (const char* path : paths)
+  {
+    std::unique_ptr<procstat::CaptureReader> reader(new procstat::CaptureReader());
+
+    if (!reader->open(path))
+    {
+      std::cerr << "Error: " << path << " cannot be open." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    uint64_t reader_first_ms = reader->get_first_time();
+    uint64_t reader_last_ms = reader->get_last_time();
+
+    if (reader_first_ms != 0 && reader_last_ms >= reader_first_ms)
+    {
+      first_ms = (reader_first_ms < first_ms) ? reader_first_ms : first_ms;
+      last_ms = (reader_last_ms > last_ms) ? reader_last_ms : last_ms;
+    }
+
+    merge.readers.push_back(std::move(reader));
+  }
+
+  if (last_ms == 0)
+  {
+    std::cerr << "Error: The files hold no records." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  //
+  //  The grid is aligned to multiples of its period,
+  //  so the slots of two runs can be compared.
+  //
+  merge.start_ms = first_ms - first_ms % merge.grid_ms;
+
+  uint64_t slot_cnt = (last_ms - merge.start_ms) / merge.grid_ms + 1;
+
+  if (slot_cnt > MAX_SLOTS)
+  {
+    std::cerr << "Error: The files cover " << slot_cnt << " slots, use a longer grid." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  merge.slots.resize(slot_cnt);
+
+  //
+  //  Merge the files on the worker threads.
+  //
+  std::vector<std::thread> threads;
+
+  for (uint32_t i = 0; i < thread_cnt && i < merge.readers.size(); i++)
+  {
+    threads.emplace_back(merge_files, &merge);
+  }
+
+  for (std::thread &thread : threads)
+  {
+    thread.join();
+  }
+
+  //
+  //  Write one CSV row per slot holding CPU samples, with their count.
+  //
+  std::cout << "time_ms,samples,busy_p50,busy_p99,steal_p50,steal_p99,intr_rate_p50,intr_rate_p99" << std::endl;
+  std::cout << std::setprecision(1) << std::fixed;
+
+  for (uint64_t i = 0; i < slot_cnt; i++)
+  {
+    const Slot &slot = merge.slots[i];
+
+    if (slot.busy.get_count() == 0)
+    {
+      continue;
+    }
+
+    std::cout << (merge.start_ms + i * merge.grid_ms) << ',' << slot.busy.get_count();
+    std::cout << ',' << slot.busy.get_percentile(50) / 10.0f << ',' << slot.busy.get_percentile(99) / 10.0f;
+    std::cout << ',' << slot.steal.get_percentile(50) / 10.0f << ',' << slot.steal.get_percentile(99) / 10.0f;
+    std::cout << ',' << slot.intr_rate.get_percentile(50) << ',' << slot.intr_rate.get_percentile(99) << '\n';
+  }
+
+  return 0;
+}
@@ -0,0 +1,241 @@
+//*****************************************************************************
+//
+//  ProcStat
+//  -------------------------------------------------------------------------
+//  File:     query.cpp
+//
+//*****************************************************************************
+//
+//  Standard input/output streams library.
+//
+#include <iostream>
+//
+//  Standard string class.
+//
+#include <string>
+//
+//  C string handling functions.
+//
+#include <cstring>
+//
+//  Header providing parametric manipulators.
+//
+#include <iomanip>
+//
+//  Header providing fixed width integer types.
+//
+#include <cstdint>
+//
+//  C standard general utilities library.
+//
+#include <cstdlib>
+//
+//  Standard vector container.
+//
+#include <vector>
+//
+//  Time library (local time conversions and clocks).
+//
+#include <ctime>
+#include <chrono>
+//
+//  CPU class.
+//
+#include "../classes/cpu.h"
+//
+//  System class.
+//
+#include "../classes/system.h"
+//
+//  Parser class.
+//
+#include "../classes/parser.h"
+//
+//  Chunk parser class.
+//
+#include "../classes/chunk_parser.h"
+//
+//  Sampler class.
+//
+#include "../classes/sampler.h"
+//
+//  Store reader and writer classes.
+//
+#include "../classes/store.h"
+
+//*****************************************************************************
+//
+//  This function displays the command line usage.
+//
+//*****************************************************************************
+static void print_usage(const char* name)
+{
+  std::cerr << "Usage: " << name << " STORE info" << std::endl;
+  std::cerr << "       " << name << " STORE max CPU FROM TO" << std::endl;
+  std::cerr << "       " << name << " STORE mean CPU FROM TO" << std::endl;
+  std::cerr << "       " << name << " STORE over PCT FROM TO" << std::endl;
+  std::cerr << "  FROM and TO are milliseconds since the epoch, or local times" << std::endl;
+  std::cerr << "  as YYYY-MM-DDTHH:MM[:SS]." << std::endl;
+}
+
+//*****************************************************************************
+//
+//  This function parses a time argument into milliseconds since the epoch.
+//  Returns false if it is not a valid time.
+//
+//*****************************************************************************
+static bool parse_time(const char* text, uint64_t &time_ms)
+{
+  char* end = nullptr;
+
+  time_ms = strtoull(text, &end, 10);
+
+  if (*text != '\0' && *end == '\0')
+  {
+    return true;
+  }
+
+  struct tm local;
+  memset(&local, 0, sizeof(local));
+
+  end = strptime(text, "%Y-%m-%dT%H:%M:%S", &local);
+
+  if (!end || *end != '\0')
+  {
+    memset(&local, 0, sizeof(local));
+    end = strptime(text, "%Y-%m-%dT%H:%M", &local);
+  }
+
+  if (!end || *end != '\0')
+  {
+    return false;
+  }
+
+  local.tm_isdst = -1;
+  time_ms = static_cast<uint64_t>(mktime(&local)) * 1000;
+
+  return true;
+}
+
+//*****************************************************************************
+//
+//  This function formats milliseconds since the epoch as a local time.
+//
+//*****************************************************************************
+static std::string format_time(uint64_t time_ms)
+{
+  time_t seconds = static_cast<time_t>(time_ms / 1000);
+  struct tm local;
+  char text[32];
+
+  localtime_r(&seconds, &local);
+  strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &local);
+
+  return text;
+}
+
+//*****************************************************************************
+//
+//  Main function.
+//
+//*****************************************************************************
+int main(int argc, char* argv[])
+{
+  procstat::StoreReader store;
+  uint64_t from_ms = 0;
+  uint64_t to_ms = 0;
+
+  if (argc < 3 || (strcmp(argv[2], "info") != 0 && argc != 6))
+  {
+    print_usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  if (!store.open(argv[1]))
+  {
+    std::cerr << "Error: " << argv[1] << " " << store.get_error() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (argc == 6 && (!parse_time(argv[4], from_ms) || !parse_time(argv[5], to_ms)))
+  {
+    std::cerr << "Error: The time range is not valid." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  std::cout << std::setprecision(1) << std::fixed;
+
+  auto start = std::chrono::steady_clock::now();
+
+  if (strcmp(argv[2], "info") == 0)
+  {
+    std::cout << "CPUs: " << store.get_cpu_count() << std::endl;
+    std::cout << "Blocks: " << store.get_block_count() << std::endl;
+    std::cout << "First sample: " << format_time(store.get_first_time()) << std::endl;
+    std::cout << "Last sample: " << format_time(store.get_last_time()) << std::endl;
+    return 0;
+  }
+  else if (strcmp(argv[2], "max") == 0 || strcmp(argv[2], "mean") == 0)
+  {
+    char* end = nullptr;
+    unsigned long cpu = strtoul(argv[3], &end, 10);
+    bool max = (strcmp(argv[2], "max") == 0);
+    float value;
+
+    if (*argv[3] == '\0' || *argv[3] == '-' || *end != '\0')
+    {
+      std::cerr << "Error: The CPU is not valid." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    if (cpu >= store.get_cpu_count())
+    {
+      std::cerr << "Error: The store holds " << store.get_cpu_count() << " CPUs." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    if (!(max ? store.get_max(static_cast<uint32_t>(cpu), from_ms, to_ms, value) :
+                store.get_mean(static_cast<uint32_t>(cpu), from_ms, to_ms, value)))
+    {
+      std::cerr << "Error: No samples in the time range." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    std::cout << "CPU" << cpu << " " << argv[2] << " busy: " << value << "%" << std::endl;
+  }
+  else if (strcmp(argv[2], "over") == 0)
+  {
+    char* end = nullptr;
+    double threshold = strtod(argv[3], &end);
+    std::vector<uint32_t> cpus;
+
+    if (*argv[3] == '\0' || *end != '\0' || !(threshold >= 0 && threshold <= 100))
+    {
+      std::cerr << "Error: The percentage must be between 0 and 100." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    store.get_cpus_over(static_cast<float>(threshold), from_ms, to_ms, cpus);
+
+    std::cout << "CPUs over " << argv[3] << "%:";
+
+    for (uint32_t cpu : cpus)
+    {
+      std::cout << " CPU" << cpu;
+    }
+    std::cout << std::endl;
+  }
+  else
+  {
+    print_usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  auto end = std::chrono::steady_clock::now();
+
+  std::cerr << std::setprecision(3) << std::fixed;
+  std::cerr << "Query: " << std::chrono::duration<double, std::milli>(end - start).count()
+            << " ms, " << store.get_scanned_count() << " blocks scanned" << std::endl;
+
+  return 0;
+}